@@ -0,0 +1,231 @@
+#include "binlogstream.h"
+#include <Poco/Exception.h>
+#include <Poco/File.h>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+namespace {
+
+const int MAGIC_BYTE_SIZE = 4;
+const int HEADER_SIZE = 19;
+const int EVENT_LENGTH_OFFSET = 9;
+
+unsigned int readUInt32(const char* data) {
+    return static_cast<unsigned char>(data[0])
+        | static_cast<unsigned char>(data[1]) << 8
+        | static_cast<unsigned char>(data[2]) << 16
+        | static_cast<unsigned int>(static_cast<unsigned char>(data[3])) << 24;
+}
+
+}
+
+//******************************
+// BINLOG FILE SEQUENCE STREAM CLASS
+//******************************
+
+BinlogStream::BinlogStream(const vector<const char*>& src_files):
+    m_src_files(src_files), m_reader(NULL), m_file_index(0), m_position(0), m_offset(0), m_next_offset(0)
+{
+}
+
+BinlogStream::~BinlogStream() {
+    close();
+}
+
+// File sizes are taken once, here; a file still being written is read to
+// its end regardless, but offsets past its size at open are not addressable.
+bool BinlogStream::open() {
+    close();
+    m_file_offsets.assign(1, 0);
+    for(vector<const char*>::const_iterator it = m_src_files.begin(); it != m_src_files.end(); ++it) {
+        try {
+            m_file_offsets.push_back(m_file_offsets.back() + Poco::File(*it).getSize());
+        }
+        catch(const Poco::Exception& e) {
+            cerr << "file open failed " << *it << endl;
+            return false;
+        }
+    }
+    return !m_src_files.empty() && openFile(0, MAGIC_BYTE_SIZE);
+}
+
+bool BinlogStream::next(const char*& event, int& event_size) {
+    if(!m_reader) return false;
+
+    const char* header = m_reader->peek(HEADER_SIZE);
+    while(!header && m_reader->begin == m_reader->end && m_file_index + 1 < static_cast<int>(m_src_files.size())) {
+        // rotation; the next file was opened ahead
+        delete m_reader;
+        m_reader = m_prefetcher.take(m_src_files[++m_file_index]);
+        m_position = MAGIC_BYTE_SIZE;
+        if(!m_reader) return false;
+        if(m_file_index + 1 < static_cast<int>(m_src_files.size()))
+            m_prefetcher.start(m_src_files[m_file_index + 1]);
+        header = m_reader->peek(HEADER_SIZE);
+    }
+    if(!header) return false;
+
+    const unsigned int event_length = readUInt32(header + EVENT_LENGTH_OFFSET);
+    if(event_length < static_cast<unsigned int>(HEADER_SIZE)) {
+        cerr << "malformed event at " << m_src_files[m_file_index] << ':' << m_position << endl;
+        return false;
+    }
+    const char* data = m_reader->peek(event_length);
+    if(!data) return false;
+    m_reader->begin += event_length;
+
+    m_offset = toOffset(m_file_index, m_position);
+    m_position += event_length;
+    m_next_offset = toOffset(m_file_index, m_position);
+    event = data;
+    event_size = event_length;
+    return true;
+}
+
+// Makes the next call of next() return the event at offset, which must be
+// an event boundary such as a saved getOffset() or getNextOffset().
+bool BinlogStream::seek(long long offset) {
+    int file_index;
+    int position;
+    if(!toPosition(offset, file_index, position)) return false;
+    if(m_reader && file_index == m_file_index) {
+        m_reader->seek(position);
+        m_position = position;
+        return !m_reader->in.fail();
+    }
+    return openFile(file_index, position);
+}
+
+bool BinlogStream::toPosition(long long offset, int& file_index, int& position) const {
+    if(offset < 0 || m_file_offsets.empty() || offset >= m_file_offsets.back()) return false;
+    file_index = upper_bound(m_file_offsets.begin(), m_file_offsets.end(), offset) - m_file_offsets.begin() - 1;
+    position = static_cast<int>(offset - m_file_offsets[file_index]);
+    return position >= MAGIC_BYTE_SIZE;
+}
+
+void BinlogStream::close() {
+    m_prefetcher.take(NULL);
+    delete m_reader;
+    m_reader = NULL;
+}
+
+bool BinlogStream::openFile(int file_index, int position) {
+    m_prefetcher.take(NULL);
+    delete m_reader;
+    m_reader = Open(m_src_files[file_index], position == MAGIC_BYTE_SIZE);
+    if(!m_reader) return false;
+    if(position != MAGIC_BYTE_SIZE) {
+        m_reader->seek(position);
+        if(m_reader->in.fail()) return false;
+    }
+    m_file_index = file_index;
+    m_position = position;
+    m_offset = m_next_offset = toOffset(file_index, position);
+    if(file_index + 1 < static_cast<int>(m_src_files.size()))
+        m_prefetcher.start(m_src_files[file_index + 1]);
+    return true;
+}
+
+// Opens a binlog file, checks its magic number and, to prefetch, fills the
+// buffer with the first events.
+BinlogStream::Reader* BinlogStream::Open(const char* src_file, bool prefetch) {
+    Reader* reader = new Reader();
+    reader->in.open(src_file, ios::in | ios::binary);
+    char magic[MAGIC_BYTE_SIZE];
+    reader->in.read(magic, sizeof magic);
+    if(!reader->in.is_open() || reader->in.gcount() != MAGIC_BYTE_SIZE || memcmp(magic, "\xfe" "bin", MAGIC_BYTE_SIZE) != 0) {
+        cerr << "file open failed " << src_file << endl;
+        delete reader;
+        return NULL;
+    }
+    if(prefetch) reader->peek(BUFFER_SIZE);
+    return reader;
+}
+
+//******************************
+// BINLOG FILE READER STRUCT
+//******************************
+
+BinlogStream::Reader::Reader():
+    buffer(BUFFER_SIZE), base(MAGIC_BYTE_SIZE), begin(0), end(0)
+{
+}
+
+// Returns the next size bytes without consuming them, or NULL when the
+// file ends first.
+const char* BinlogStream::Reader::peek(int size) {
+    if(end - begin < static_cast<size_t>(size)) {
+        copy(buffer.begin() + begin, buffer.begin() + end, buffer.begin());
+        base += begin;
+        end -= begin;
+        begin = 0;
+        if(buffer.size() < static_cast<size_t>(size)) buffer.resize(size);
+        in.read(&buffer[end], buffer.size() - end);
+        end += in.gcount();
+        // keep the stream seekable after running into the end of the file
+        in.clear();
+        if(end < static_cast<size_t>(size)) return NULL;
+    }
+    return &buffer[begin];
+}
+
+// The buffer holds the file from base on. A position before it is most
+// likely a step of a backward walk, so the buffer is refilled from half a
+// buffer earlier, and the steps that follow are served from it too.
+void BinlogStream::Reader::seek(int position) {
+    if(position >= base && static_cast<size_t>(position - base) <= end) {
+        begin = position - base;
+        return;
+    }
+    base = position < base ? max(MAGIC_BYTE_SIZE, position - BUFFER_SIZE / 2) : position;
+    begin = position - base;
+    end = 0;
+    in.clear();
+    in.seekg(base);
+    if(begin > 0) {
+        in.read(&buffer[0], buffer.size());
+        end = in.gcount();
+        in.clear();
+    }
+}
+
+//******************************
+// NEXT FILE PREFETCHER CLASS
+//******************************
+
+BinlogStream::Prefetcher::Prefetcher():
+    m_running(false), m_src_file(NULL), m_reader(NULL)
+{
+}
+
+BinlogStream::Prefetcher::~Prefetcher() {
+    take(NULL);
+}
+
+void BinlogStream::Prefetcher::start(const char* src_file) {
+    take(NULL);
+    m_src_file = src_file;
+    m_running = true;
+    m_thread.start(*this);
+}
+
+// Waits for the file being opened and returns it if it is src_file;
+// otherwise, or with src_file NULL, discards it and opens src_file here.
+BinlogStream::Reader* BinlogStream::Prefetcher::take(const char* src_file) {
+    const bool prefetched = m_running && src_file == m_src_file;
+    if(m_running) {
+        m_thread.join();
+        m_running = false;
+    }
+    Reader* reader = m_reader;
+    m_reader = NULL;
+    if(prefetched) return reader;
+    delete reader;
+    return src_file ? Open(src_file, true) : NULL;
+}
+
+void BinlogStream::Prefetcher::run() {
+    m_reader = Open(m_src_file, true);
+}
@@ -0,0 +1,99 @@
+#ifndef BINLOGSTREAM_H_202610192330
+#define BINLOGSTREAM_H_202610192330
+
+#include "mysqlbinlog.h"
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <fstream>
+#include <vector>
+
+// A sequence of rotated binlog files read as one stream of events, e.g.
+// by MySQLBinlog::open(EventSource*). Offsets are global: the sizes of the
+// files before an event's own plus its position there, so they address
+// any event of the sequence and need 64 bits. While a file is read the
+// next one is opened, and its first bytes read, by a background thread,
+// so crossing a rotation does not wait for the disk.
+class BinlogStream: public EventSource {
+ public:
+    explicit BinlogStream(const std::vector<const char*>& src_files);
+    virtual ~BinlogStream();
+
+ public:
+    bool open();
+    virtual bool next(const char*& event, int& event_size);
+    bool seek(long long offset);
+    void close();
+
+ public:
+    long long getOffset() const {
+        return m_offset;
+    };
+    long long getNextOffset() const {
+        return m_next_offset;
+    };
+    long long getSize() const {
+        return m_file_offsets.back();
+    };
+    int getFileIndex() const {
+        return m_file_index;
+    };
+    const char* getFileName(int file_index) const {
+        return m_src_files[file_index];
+    };
+    long long toOffset(int file_index, int position) const {
+        return m_file_offsets[file_index] + position;
+    };
+    bool toPosition(long long offset, int& file_index, int& position) const;
+
+ private:
+    // an open file read through a buffer; peek() hands out events in
+    // place, refilling the buffer only when one runs past its end, and
+    // seek() stays in the buffer when it can
+    struct Reader {
+        Reader();
+        const char* peek(int size);
+        void seek(int position);
+
+        std::ifstream in;
+        std::vector<char> buffer;
+        int base;
+        size_t begin;
+        size_t end;
+    };
+
+    class Prefetcher: public Poco::Runnable {
+     public:
+        Prefetcher();
+        ~Prefetcher();
+        void start(const char* src_file);
+        Reader* take(const char* src_file);
+        virtual void run();
+
+     private:
+        Poco::Thread m_thread;
+        bool m_running;
+        const char* m_src_file;
+        Reader* m_reader;
+    };
+
+ private:
+    static Reader* Open(const char* src_file, bool prefetch);
+    bool openFile(int file_index, int position);
+
+ private:
+    static const int BUFFER_SIZE = 1024 * 1024;
+
+ private:
+    const std::vector<const char*> m_src_files;
+    std::vector<long long> m_file_offsets;
+
+ private:
+    Reader* m_reader;
+    Prefetcher m_prefetcher;
+    int m_file_index;
+    int m_position;
+    long long m_offset;
+    long long m_next_offset;
+};
+
+#endif // #ifndef BINLOGSTREAM_H_202610192330
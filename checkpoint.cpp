@@ -0,0 +1,206 @@
+#include "checkpoint.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+bool writeAll(int fd, const string& data) {
+    size_t written = 0;
+    while(written < data.size()) {
+        const ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+// The rename itself is made durable by syncing the directory holding it.
+bool syncDirectory(const string& path) {
+    const string::size_type slash = path.rfind('/');
+    const string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int fd = ::open(dir.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+}
+
+//******************************
+// CHECKPOINT CLASS
+//******************************
+
+Checkpoint::Checkpoint():
+    position(0)
+{
+}
+
+// binlog	NAME
+// position	POS
+// table	ID	DB	TABLE	TYPE:META	TYPE:META ...
+bool Checkpoint::load(const string& path) {
+    binlog_name.clear();
+    position = 0;
+    table_map.clear();
+    meta_map.clear();
+
+    ifstream in(path.c_str());
+    if(!in.is_open()) return true;
+
+    string line;
+    while(getline(in, line)) {
+        vector<string> fields;
+        stringstream ss(line);
+        string field;
+        while(getline(ss, field, '\t')) fields.push_back(field);
+        if(fields.empty()) continue;
+
+        if(fields[0] == "binlog" && fields.size() == 2) {
+            binlog_name = fields[1];
+        }
+        else if(fields[0] == "position" && fields.size() == 2) {
+            position = atoi(fields[1].c_str());
+        }
+        else if(fields[0] == "table" && fields.size() >= 4) {
+            const TableId table_id = strtoull(fields[1].c_str(), NULL, 10);
+            table_map[table_id] = pss(fields[2], fields[3]);
+            pvv& meta = meta_map[table_id];
+            for(size_t i = 4; i < fields.size(); ++i) {
+                char* endp = NULL;
+                meta.first.push_back(static_cast<ColumnType>(strtol(fields[i].c_str(), &endp, 10)));
+                if(*endp != ':') {
+                    cerr << "malformed checkpoint " << path << endl;
+                    return false;
+                }
+                meta.second.push_back(atoi(endp + 1));
+            }
+        }
+        else {
+            cerr << "malformed checkpoint " << path << endl;
+            return false;
+        }
+    }
+
+    if(binlog_name.empty() || position < 4) {
+        cerr << "malformed checkpoint " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+string Checkpoint::format(size_t& position_offset) const {
+    ostringstream out;
+    out << "binlog" << '\t' << binlog_name << '\n'
+        << "position" << '\t';
+    position_offset = out.str().size();
+    char digits[POSITION_WIDTH + 1];
+    snprintf(digits, sizeof digits, "%0*d", POSITION_WIDTH, position);
+    out << digits << '\n';
+    for(TableMap::const_iterator it = table_map.begin(); it != table_map.end(); ++it) {
+        out << "table" << '\t' << it->first << '\t' << it->second.first << '\t' << it->second.second;
+        MetaMap::const_iterator mit = meta_map.find(it->first);
+        if(mit != meta_map.end()) {
+            for(size_t i = 0; i < mit->second.first.size(); ++i)
+                out << '\t' << mit->second.first[i] << ':' << mit->second.second[i];
+        }
+        out << '\n';
+    }
+    return out.str();
+}
+
+//******************************
+// CHECKPOINTED OUTPUT CLASS
+//******************************
+
+CheckpointedOutput::CheckpointedOutput(ostream& out, Checkpoint& checkpoint, const string& path):
+    m_out(out), m_out_buf(out.rdbuf()), m_checkpoint(checkpoint), m_path(path),
+    m_unsynced_size(0), m_dirty(false), m_fd(-1), m_position_offset(0)
+{
+    m_out.rdbuf(m_pending.rdbuf());
+}
+
+CheckpointedOutput::~CheckpointedOutput() {
+    m_out.rdbuf(m_out_buf);
+    if(m_fd >= 0) close(m_fd);
+}
+
+// The output is written out before the checkpoint moves past it.
+bool CheckpointedOutput::commit(int next_position, const TableMap& table_map, const MetaMap& meta_map) {
+    const string output = m_pending.str();
+    m_pending.str("");
+    m_out_buf->sputn(output.data(), output.size());
+    if(m_out_buf->pubsync() != 0) {
+        cerr << "write failed" << endl;
+        return false;
+    }
+
+    const bool changed = m_fd < 0 || m_saved_binlog_name != m_checkpoint.binlog_name ||
+        m_checkpoint.table_map != table_map || m_checkpoint.meta_map != meta_map;
+    m_checkpoint.position = next_position;
+    if(changed) {
+        m_checkpoint.table_map = table_map;
+        m_checkpoint.meta_map = meta_map;
+        return rewrite();
+    }
+
+    m_unsynced_size += output.size();
+    m_dirty = true;
+    if(!writePosition()) return false;
+    return m_unsynced_size < SYNC_SIZE || sync();
+}
+
+bool CheckpointedOutput::flush() {
+    return !m_dirty || sync();
+}
+
+// The temporary file is synced before it is renamed, so a crash cannot
+// leave a checkpoint whose contents never reached the disk.
+bool CheckpointedOutput::rewrite() {
+    size_t position_offset;
+    const string data = m_checkpoint.format(position_offset);
+    const string tmp_path = m_path + ".tmp";
+    const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    const bool succeeded = fd >= 0 && writeAll(fd, data) && fsync(fd) == 0;
+    if(!succeeded || rename(tmp_path.c_str(), m_path.c_str()) != 0 || !syncDirectory(m_path)) {
+        cerr << "cannot write checkpoint " << m_path << ": " << strerror(errno) << endl;
+        if(fd >= 0) close(fd);
+        return false;
+    }
+    if(m_fd >= 0) close(m_fd);
+    m_fd = fd;
+    m_position_offset = position_offset;
+    m_saved_binlog_name = m_checkpoint.binlog_name;
+    m_unsynced_size = 0;
+    m_dirty = false;
+    return true;
+}
+
+bool CheckpointedOutput::writePosition() {
+    char digits[Checkpoint::POSITION_WIDTH + 1];
+    snprintf(digits, sizeof digits, "%0*d", Checkpoint::POSITION_WIDTH, m_checkpoint.position);
+    if(pwrite(m_fd, digits, Checkpoint::POSITION_WIDTH, m_position_offset) != Checkpoint::POSITION_WIDTH) {
+        cerr << "cannot write checkpoint " << m_path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointedOutput::sync() {
+    if(fdatasync(m_fd) != 0) {
+        cerr << "cannot write checkpoint " << m_path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    m_unsynced_size = 0;
+    m_dirty = false;
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef CHECKPOINT_H_202610192100
+#define CHECKPOINT_H_202610192100
+
+#include "mysqlbinlog.h"
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// Where a previous run stopped: the binlog file and the position just
+// after its last complete transaction, with the table maps known there.
+// format() writes the position with a fixed width, so that it can be
+// overwritten in place. A missing file loads as an empty checkpoint.
+struct Checkpoint {
+    Checkpoint();
+
+    bool load(const std::string& path);
+    std::string format(size_t& position_offset) const;
+    bool empty() const {
+        return binlog_name.empty();
+    };
+
+    static const int POSITION_WIDTH = 10;
+
+    std::string binlog_name;
+    int position;
+    TableMap table_map;
+    MetaMap meta_map;
+};
+
+// Redirects a stream into a buffer for as long as it lives, and hands the
+// output of each transaction on only once it is complete, then saves the
+// checkpoint after it: a run that is killed repeats at most the
+// transaction it was handing on, output is never lost, and an incomplete
+// transaction at the end of the input is printed once, by the run that
+// sees all of it.
+//
+// The checkpoint is rewritten whole, into a synced temporary file renamed
+// over the old one, only when its binlog or table maps change. Otherwise
+// only the position is overwritten in place, a write of a few bytes that
+// cannot be torn, and synced to disk every SYNC_SIZE of output and at the
+// end; a crash of the system may repeat up to that much.
+class CheckpointedOutput {
+ public:
+    CheckpointedOutput(std::ostream& out, Checkpoint& checkpoint, const std::string& path);
+    ~CheckpointedOutput();
+
+ public:
+    bool commit(int next_position, const TableMap& table_map, const MetaMap& meta_map);
+    bool flush();
+
+ private:
+    bool rewrite();
+    bool writePosition();
+    bool sync();
+
+ private:
+    static const size_t SYNC_SIZE = 64 * 1024;
+
+ private:
+    std::ostream& m_out;
+    std::streambuf* const m_out_buf;
+    Checkpoint& m_checkpoint;
+    const std::string m_path;
+
+ private:
+    std::stringstream m_pending;
+    size_t m_unsynced_size;
+    bool m_dirty;
+
+ private:
+    // the checkpoint file last renamed into place, and what it holds
+    int m_fd;
+    size_t m_position_offset;
+    std::string m_saved_binlog_name;
+};
+
+#endif // #ifndef CHECKPOINT_H_202610192100
@@ -0,0 +1,172 @@
+#include "checksum.h"
+#include "util.h"
+#include <Poco/Thread.h>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+using namespace std;
+
+namespace {
+
+// tags hashed with each row image, so that e.g. deleting a row and
+// inserting it do not cancel out
+enum Operation {
+    OP_WRITE = 1, OP_UPDATE_BEFORE = 2, OP_UPDATE_AFTER = 3, OP_DELETE = 4
+};
+
+}
+
+//******************************
+// CHANGE CHECKSUM CLASS
+//******************************
+
+ChangeChecksum::Cell::Cell():
+    rows(0), sum(0), xor_sum(0)
+{
+}
+
+ChangeChecksum::ChangeChecksum(int bucket_seconds, int num_of_threads):
+    m_bucket_seconds(bucket_seconds), m_num_of_threads(num_of_threads > 0 ? num_of_threads : 1),
+    m_src_files(NULL), m_next_file(0), m_succeeded(true)
+{
+}
+
+// FNV-1a, finished with the splitmix64 mixer so that the low bits the sum
+// depends on are as random as the high ones.
+unsigned long long ChangeChecksum::HashRow(int operation, const char* data, int size) {
+    unsigned long long h = 14695981039346656037ULL;
+    h ^= static_cast<unsigned char>(operation);
+    h *= 1099511628211ULL;
+    for(int i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+bool ChangeChecksum::run(const vector<const char*>& src_files) {
+    m_src_files = &src_files;
+    m_next_file = 0;
+    m_succeeded = true;
+
+    const int num_of_threads = min(m_num_of_threads, static_cast<int>(src_files.size()));
+    vector<Worker*> workers;
+    vector<Poco::Thread*> threads;
+    for(int i = 0; i < num_of_threads; ++i) {
+        workers.push_back(new Worker(*this));
+        threads.push_back(new Poco::Thread());
+        threads.back()->start(*workers.back());
+    }
+    for(int i = 0; i < num_of_threads; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        delete workers[i];
+    }
+    m_src_files = NULL;
+    return m_succeeded;
+}
+
+// Row images are walked in place by RowScanner, the way
+// Event::__parseRowsEventData finds them, but never formatted.
+bool ChangeChecksum::scan(const char* src_file, Cells& cells) const {
+    RowEventReader reader;
+    if(!reader.open(src_file)) return false;
+    MySQLBinlog& parser = reader.getParser();
+    const TableMap& table_map = reader.getTableMaps().getTableMap();
+
+    // consecutive events mostly add to the same cell
+    Cell* last_cell = NULL;
+    TableId last_table_id = 0;
+    long long last_bucket = 0;
+
+    while(reader.next()) {
+        const TypeCode type = reader.getTypeCode();
+
+        if(TABLE_MAP_EVENT == type) {
+            last_cell = NULL;
+            continue;
+        }
+
+        RowScanner scanner(parser.getData(), parser.getDataSize(), reader.getTableMaps().getMetaMap(), UPDATE_ROWS_EVENT == type);
+        if(!scanner.isValid()) continue;
+        const long long bucket = parser.getTimestamp() / m_bucket_seconds;
+        if(!last_cell || last_table_id != scanner.getTableId() || last_bucket != bucket) {
+            TableMap::const_iterator tit = table_map.find(scanner.getTableId());
+            if(tit == table_map.end()) continue;
+            last_cell = &cells[make_pair(tit->second, bucket)];
+            last_table_id = scanner.getTableId();
+            last_bucket = bucket;
+        }
+        Cell& cell = *last_cell;
+        while(scanner.next()) {
+            const int operation = WRITE_ROWS_EVENT == type ? OP_WRITE :
+                                  DELETE_ROWS_EVENT == type ? OP_DELETE :
+                                  scanner.isAfterImage() ? OP_UPDATE_AFTER : OP_UPDATE_BEFORE;
+            const unsigned long long h = HashRow(operation, scanner.getRowData(), scanner.getRowSize());
+            ++cell.rows;
+            cell.sum += h;
+            cell.xor_sum ^= h;
+        }
+    }
+
+    reader.close();
+    return true;
+}
+
+void ChangeChecksum::merge(const Cells& cells) {
+    for(Cells::const_iterator it = cells.begin(); it != cells.end(); ++it) {
+        Cell& cell = m_cells[it->first];
+        cell.rows += it->second.rows;
+        cell.sum += it->second.sum;
+        cell.xor_sum ^= it->second.xor_sum;
+    }
+}
+
+void ChangeChecksum::print(ostream& out) const {
+    out << "database\ttable\ttime\trows\tsum\txor" << '\n';
+    for(Cells::const_iterator it = m_cells.begin(); it != m_cells.end(); ++it) {
+        char sum[17];
+        char xor_sum[17];
+        snprintf(sum, sizeof sum, "%016llx", it->second.sum);
+        snprintf(xor_sum, sizeof xor_sum, "%016llx", it->second.xor_sum);
+        out << it->first.first.first << '\t'
+            << it->first.first.second << '\t'
+            << formatTimestamp(it->first.second * m_bucket_seconds) << '\t'
+            << it->second.rows << '\t'
+            << sum << '\t'
+            << xor_sum << '\n';
+    }
+    out << flush;
+}
+
+//******************************
+// CHECKSUM WORKER THREAD CLASS
+//******************************
+
+ChangeChecksum::Worker::Worker(ChangeChecksum& checksum):
+    m_checksum(checksum)
+{
+}
+
+void ChangeChecksum::Worker::run() {
+    for(;;) {
+        size_t i;
+        {
+            Poco::Mutex::ScopedLock lock(m_checksum.m_mutex);
+            if(m_checksum.m_next_file >= m_checksum.m_src_files->size()) break;
+            i = m_checksum.m_next_file++;
+        }
+
+        Cells cells;
+        const bool succeeded = m_checksum.scan((*m_checksum.m_src_files)[i], cells);
+
+        Poco::Mutex::ScopedLock lock(m_checksum.m_mutex);
+        m_checksum.merge(cells);
+        m_checksum.m_succeeded = m_checksum.m_succeeded && succeeded;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CHECKSUM_H_202610200000
+#define CHECKSUM_H_202610200000
+
+#include "mysqlbinlog.h"
+#include <Poco/Mutex.h>
+#include <Poco/Runnable.h>
+#include <ostream>
+#include <map>
+#include <vector>
+
+// Order-independent checksums of the row changes per (database, table,
+// time bucket), for comparing what a primary and a replica applied. Each
+// row image is hashed from its raw bytes with the operation that wrote it,
+// and the hashes are combined by sum and by XOR, so the result does not
+// depend on event order or on how rows were split into events and files.
+// Files are read by a pool of threads and their results merged.
+class ChangeChecksum {
+ public:
+    ChangeChecksum(int bucket_seconds, int num_of_threads);
+
+ public:
+    bool run(const std::vector<const char*>& src_files);
+    void print(std::ostream& out) const;
+
+ public:
+    static unsigned long long HashRow(int operation, const char* data, int size);
+
+ private:
+    struct Cell {
+        Cell();
+        long long rows;
+        unsigned long long sum;
+        unsigned long long xor_sum;
+    };
+    typedef std::map<std::pair<pss, long long>, Cell> Cells;
+
+    class Worker: public Poco::Runnable {
+     public:
+        explicit Worker(ChangeChecksum& checksum);
+        virtual void run();
+
+     private:
+        ChangeChecksum& m_checksum;
+    };
+
+ private:
+    bool scan(const char* src_file, Cells& cells) const;
+    void merge(const Cells& cells);
+
+ private:
+    const int m_bucket_seconds;
+    const int m_num_of_threads;
+
+ private:
+    Poco::Mutex m_mutex;
+    const std::vector<const char*>* m_src_files;
+    size_t m_next_file;
+    bool m_succeeded;
+    Cells m_cells;
+};
+
+#endif // #ifndef CHECKSUM_H_202610200000
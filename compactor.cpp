@@ -0,0 +1,389 @@
+#include "compactor.h"
+#include "util.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <cstdlib>
+using namespace std;
+
+namespace {
+
+// rough per-entry cost of the hash node, the Change and the string headers
+const long long ENTRY_OVERHEAD = 128;
+
+void appendKeyBytes(string& key, const char* data, int size) {
+    const unsigned char length[4] = {
+        static_cast<unsigned char>(size), static_cast<unsigned char>(size >> 8),
+        static_cast<unsigned char>(size >> 16), static_cast<unsigned char>(size >> 24)
+    };
+    key.append(reinterpret_cast<const char*>(length), sizeof length);
+    key.append(data, size);
+}
+
+string makeKey(int table_index, const RowScanner& scanner, const vector<int>& columns) {
+    string key;
+    appendKeyBytes(key, reinterpret_cast<const char*>(&table_index), sizeof table_index);
+    for(vector<int>::const_iterator it = columns.begin(); it != columns.end(); ++it) {
+        if(*it >= scanner.getNumOfColumns() || !scanner.isUsed(*it) || scanner.isNull(*it)) {
+            key += '\0';
+            continue;
+        }
+        key += '\1';
+        appendKeyBytes(key, scanner.getColumnData(*it), scanner.getColumnSize(*it));
+    }
+    return key;
+}
+
+void writeInt(ostream& out, long long n) {
+    out.write(reinterpret_cast<const char*>(&n), sizeof n);
+}
+
+bool readInt(istream& in, long long& n) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&n), sizeof n));
+}
+
+void writeString(ostream& out, const string& s) {
+    writeInt(out, s.size());
+    out.write(s.data(), s.size());
+}
+
+bool readString(istream& in, string& s) {
+    long long size;
+    if(!readInt(in, size) || size < 0) return false;
+    s.resize(size);
+    return size == 0 || static_cast<bool>(in.read(&s[0], size));
+}
+
+void writeRow(ostream& out, const RowImg& row) {
+    writeInt(out, row.size());
+    for(RowImg::const_iterator it = row.begin(); it != row.end(); ++it) writeString(out, *it);
+}
+
+bool readRow(istream& in, RowImg& row) {
+    long long size;
+    if(!readInt(in, size) || size < 0) return false;
+    row.resize(size);
+    for(RowImg::iterator it = row.begin(); it != row.end(); ++it)
+        if(!readString(in, *it)) return false;
+    return true;
+}
+
+}
+
+//******************************
+// NET CHANGE COMPACTOR CLASS
+//******************************
+
+Compactor::Compactor(const KeyColumns& key_columns, long long memory_budget):
+    m_key_columns(key_columns), m_memory_budget(memory_budget), m_memory_usage(0), m_seq(0), m_spilled(false),
+    m_spill_files(NUM_OF_PARTITIONS, static_cast<Poco::TemporaryFile*>(NULL)),
+    m_spill_streams(NUM_OF_PARTITIONS, static_cast<ofstream*>(NULL))
+{
+}
+
+Compactor::~Compactor() {
+    for(int i = 0; i < NUM_OF_PARTITIONS; ++i) {
+        delete m_spill_streams[i];
+        delete m_spill_files[i];
+    }
+}
+
+bool Compactor::ParseKeyColumns(const string& text, KeyColumns& key_columns) {
+    const string::size_type colon = text.rfind(':');
+    const string::size_type dot = text.find('.');
+    if(colon == string::npos || dot == string::npos || dot > colon) return false;
+
+    const pss table(text.substr(0, dot), text.substr(dot + 1, colon - dot - 1));
+    vector<int> columns;
+    const char* p = text.c_str() + colon + 1;
+    while(*p) {
+        char* endp = NULL;
+        const long column = strtol(p, &endp, 10);
+        if(endp == p || column < 0 || (*endp != ',' && *endp != '\0')) return false;
+        columns.push_back(static_cast<int>(column));
+        p = *endp ? endp + 1 : endp;
+    }
+    if(table.first.empty() || table.second.empty() || columns.empty()) return false;
+    key_columns[table] = columns;
+    return true;
+}
+
+bool Compactor::scan(const char* src_file) {
+    RowEventReader reader;
+    if(!reader.open(src_file)) return false;
+    MySQLBinlog& parser = reader.getParser();
+    const TableMap& table_map = reader.getTableMaps().getTableMap();
+    const MetaMap& meta_map = reader.getTableMaps().getMetaMap();
+
+    while(reader.next()) {
+        const TypeCode type = reader.getTypeCode();
+        if(TABLE_MAP_EVENT == type) continue;
+
+        TableMap::const_iterator tit = table_map.find(Event::ReadTableId(parser.getData()));
+        if(tit == table_map.end()) continue;
+        KeyColumns::const_iterator kit = m_key_columns.find(tit->second);
+        if(kit == m_key_columns.end()) continue;
+
+        map<pss,int>::iterator iit = m_table_indexes.find(tit->second);
+        if(iit == m_table_indexes.end()) {
+            iit = m_table_indexes.insert(make_pair(tit->second, static_cast<int>(m_tables.size()))).first;
+            m_tables.push_back(tit->second);
+        }
+        const int table_index = iit->second;
+
+        const Event* event = parser.getEvent(table_map, meta_map);
+        const vector<RowImg>& rows = event->getRows();
+        RowScanner scanner(parser.getData(), parser.getDataSize(), meta_map, UPDATE_ROWS_EVENT == type);
+
+        for(vector<RowImg>::const_iterator it = rows.begin(); it != rows.end() && scanner.next(); ++it) {
+            Change change;
+            change.seq = m_seq++;
+            change.timestamp = event->getTimestamp();
+            change.table_index = table_index;
+            change.has_before = WRITE_ROWS_EVENT != type;
+            change.has_after = DELETE_ROWS_EVENT != type;
+
+            if(UPDATE_ROWS_EVENT != type) {
+                (change.has_before ? change.before : change.after) = *it;
+                fold(makeKey(table_index, scanner, kit->second), change);
+                continue;
+            }
+
+            // an update is folded as a delete of its before image and an
+            // insert of its after image, unless the key is unchanged
+            const string before_key = makeKey(table_index, scanner, kit->second);
+            change.before = *it;
+            if(++it == rows.end() || !scanner.next()) break;
+            const string after_key = makeKey(table_index, scanner, kit->second);
+            change.after = *it;
+
+            if(before_key == after_key) {
+                fold(before_key, change);
+            }
+            else {
+                Change removed(change);
+                removed.has_after = false;
+                removed.after.clear();
+                fold(before_key, removed);
+                change.seq = m_seq++;
+                change.has_before = false;
+                change.before.clear();
+                fold(after_key, change);
+            }
+        }
+
+        delete event;
+
+        if(m_memory_usage > m_memory_budget) spill();
+    }
+
+    reader.close();
+    return true;
+}
+
+void Compactor::fold(const string& key, Change& change) {
+    ChangeMap::iterator it = m_changes.find(key);
+    if(it == m_changes.end()) {
+        if(!change.has_before && !change.has_after) return;
+        m_memory_usage += ChangeSize(key, change);
+        m_changes.insert(make_pair(key, change));
+        return;
+    }
+
+    Change& net = it->second;
+    m_memory_usage -= ChangeSize(key, net);
+    net.timestamp = change.timestamp;
+    net.has_after = change.has_after;
+    net.after.swap(change.after);
+
+    if(!net.has_before && !net.has_after) {
+        m_changes.erase(it);
+        return;
+    }
+    m_memory_usage += ChangeSize(key, net);
+}
+
+long long Compactor::ChangeSize(const string& key, const Change& change) {
+    long long size = ENTRY_OVERHEAD + key.size();
+    for(RowImg::const_iterator it = change.before.begin(); it != change.before.end(); ++it)
+        size += sizeof(string) + it->size();
+    for(RowImg::const_iterator it = change.after.begin(); it != change.after.end(); ++it)
+        size += sizeof(string) + it->size();
+    return size;
+}
+
+void Compactor::spill() {
+    const hash<string> hasher;
+    for(ChangeMap::const_iterator it = m_changes.begin(); it != m_changes.end(); ++it) {
+        const int partition = hasher(it->first) % NUM_OF_PARTITIONS;
+        if(!m_spill_streams[partition]) {
+            m_spill_files[partition] = new Poco::TemporaryFile();
+            m_spill_streams[partition] = new ofstream(m_spill_files[partition]->path().c_str(), ios::out | ios::binary | ios::trunc);
+        }
+        WriteChange(*m_spill_streams[partition], it->first, it->second);
+    }
+    m_changes.clear();
+    m_memory_usage = 0;
+    m_spilled = true;
+}
+
+void Compactor::WriteChange(ostream& out, const string& key, const Change& change) {
+    writeInt(out, change.seq);
+    writeInt(out, change.timestamp);
+    writeInt(out, change.table_index);
+    writeString(out, key);
+    writeInt(out, change.has_before);
+    writeRow(out, change.before);
+    writeInt(out, change.has_after);
+    writeRow(out, change.after);
+}
+
+bool Compactor::ReadChange(istream& in, string& key, Change& change) {
+    long long timestamp, table_index, has_before, has_after;
+    if(!(readInt(in, change.seq) &&
+         readInt(in, timestamp) &&
+         readInt(in, table_index) &&
+         readString(in, key) &&
+         readInt(in, has_before) &&
+         readRow(in, change.before) &&
+         readInt(in, has_after) &&
+         readRow(in, change.after))) return false;
+    change.timestamp = static_cast<int>(timestamp);
+    change.table_index = static_cast<int>(table_index);
+    change.has_before = has_before != 0;
+    change.has_after = has_after != 0;
+    return true;
+}
+
+// Spilled runs are written in order, so refolding a partition run by run
+// composes each key's changes in the order they happened.
+bool Compactor::foldPartition(int partition) {
+    m_changes.clear();
+    m_memory_usage = 0;
+    if(!m_spill_files[partition]) return true;
+
+    ifstream in(m_spill_files[partition]->path().c_str(), ios::in | ios::binary);
+    if(!in) {
+        cerr << "cannot read spill file " << m_spill_files[partition]->path() << endl;
+        return false;
+    }
+    string key;
+    Change change;
+    while(in.peek() != EOF) {
+        if(!ReadChange(in, key, change)) {
+            cerr << "broken spill file " << m_spill_files[partition]->path() << endl;
+            return false;
+        }
+        fold(key, change);
+    }
+    return true;
+}
+
+bool Compactor::print(ostream& out) {
+    if(!m_spilled) {
+        printChanges(out);
+        return true;
+    }
+
+    spill();
+    for(int i = 0; i < NUM_OF_PARTITIONS; ++i)
+        if(m_spill_streams[i]) m_spill_streams[i]->close();
+
+    for(int i = 0; i < NUM_OF_PARTITIONS; ++i)
+        if(!foldPartition(i) || !writeSortedPartition(i)) return false;
+    m_changes.clear();
+    return mergePartitions(out);
+}
+
+// The folded partition replaces its spill file, in seq order.
+bool Compactor::writeSortedPartition(int partition) const {
+    if(!m_spill_files[partition]) return true;
+
+    const string& path = m_spill_files[partition]->path();
+    ofstream out(path.c_str(), ios::out | ios::binary | ios::trunc);
+    const vector<const ChangeMap::value_type*> changes = sortedChanges();
+    for(vector<const ChangeMap::value_type*>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+        WriteChange(out, (*it)->first, (*it)->second);
+    out.close();
+    if(!out) {
+        cerr << "cannot write spill file " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+// A k-way merge of the sorted partitions, holding one change of each.
+bool Compactor::mergePartitions(ostream& out) const {
+    typedef pair<long long,int> SeqPartition;
+    priority_queue<SeqPartition, vector<SeqPartition>, greater<SeqPartition> > queue;
+    vector<ifstream*> ins(NUM_OF_PARTITIONS, static_cast<ifstream*>(NULL));
+    vector<string> keys(NUM_OF_PARTITIONS);
+    vector<Change> heads(NUM_OF_PARTITIONS);
+    bool succeeded = true;
+
+    for(int i = 0; succeeded && i < NUM_OF_PARTITIONS; ++i) {
+        if(!m_spill_files[i]) continue;
+        ins[i] = new ifstream(m_spill_files[i]->path().c_str(), ios::in | ios::binary);
+        if(!*ins[i]) {
+            cerr << "cannot read spill file " << m_spill_files[i]->path() << endl;
+            succeeded = false;
+        }
+        else if(ins[i]->peek() != EOF) {
+            succeeded = ReadChange(*ins[i], keys[i], heads[i]);
+            if(succeeded) queue.push(make_pair(heads[i].seq, i));
+            else cerr << "broken spill file " << m_spill_files[i]->path() << endl;
+        }
+    }
+
+    while(succeeded && !queue.empty()) {
+        const int i = queue.top().second;
+        queue.pop();
+        printChange(out, heads[i]);
+        if(ins[i]->peek() == EOF) continue;
+        succeeded = ReadChange(*ins[i], keys[i], heads[i]);
+        if(succeeded) queue.push(make_pair(heads[i].seq, i));
+        else cerr << "broken spill file " << m_spill_files[i]->path() << endl;
+    }
+    out << flush;
+
+    for(int i = 0; i < NUM_OF_PARTITIONS; ++i) delete ins[i];
+    return succeeded;
+}
+
+vector<const Compactor::ChangeMap::value_type*> Compactor::sortedChanges() const {
+    vector<const ChangeMap::value_type*> changes;
+    changes.reserve(m_changes.size());
+    for(ChangeMap::const_iterator it = m_changes.begin(); it != m_changes.end(); ++it)
+        changes.push_back(&*it);
+
+    struct BySeq {
+        bool operator()(const ChangeMap::value_type* a, const ChangeMap::value_type* b) const {
+            return a->second.seq < b->second.seq;
+        }
+    };
+    sort(changes.begin(), changes.end(), BySeq());
+    return changes;
+}
+
+void Compactor::printChanges(ostream& out) const {
+    const vector<const ChangeMap::value_type*> changes = sortedChanges();
+    for(vector<const ChangeMap::value_type*>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+        printChange(out, (*it)->second);
+    out << flush;
+}
+
+void Compactor::printChange(ostream& out, const Change& change) const {
+    const pss& table = m_tables[change.table_index];
+
+    out << formatTimestamp(change.timestamp) << " UTC" << '\t';
+    if(change.has_before && change.has_after) out << "UPDATE_ROWS_EVENT";
+    else if(change.has_after) out << "WRITE_ROWS_EVENT";
+    else out << "DELETE_ROWS_EVENT";
+    out << '\t' << table.first << '\t' << table.second << '\t';
+
+    if(change.has_before) printRowImg(out, change.before);
+    if(change.has_before && change.has_after) out << " => ";
+    if(change.has_after) printRowImg(out, change.after);
+    out << '\n';
+}
@@ -0,0 +1,82 @@
+#ifndef COMPACTOR_H_202610191600
+#define COMPACTOR_H_202610191600
+
+#include "mysqlbinlog.h"
+#include <Poco/TemporaryFile.h>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+typedef std::map<pss,std::vector<int> > KeyColumns;
+
+// Folds WRITE/UPDATE/DELETE rows into the net change per key over the whole
+// window. A change keeps the image before its first row event and after its
+// last one, so an insert followed by updates stays one insert and an insert
+// followed by a delete disappears. When the accounted memory exceeds the
+// budget, changes are spilled to hash partitions on disk and folded again
+// partition by partition at the end; the folded partitions are merged back
+// in the order the changes happened, so the output does not depend on the
+// budget.
+class Compactor {
+ public:
+    Compactor(const KeyColumns& key_columns, long long memory_budget);
+    ~Compactor();
+
+ public:
+    bool scan(const char* src_file);
+    bool print(std::ostream& out);
+
+ public:
+    static bool ParseKeyColumns(const std::string& text, KeyColumns& key_columns);
+
+ private:
+    struct Change {
+        long long seq;
+        int timestamp;
+        int table_index;
+        bool has_before;
+        RowImg before;
+        bool has_after;
+        RowImg after;
+    };
+    typedef std::unordered_map<std::string,Change> ChangeMap;
+
+ private:
+    void fold(const std::string& key, Change& change);
+    void spill();
+    bool foldPartition(int partition);
+    bool writeSortedPartition(int partition) const;
+    bool mergePartitions(std::ostream& out) const;
+    std::vector<const ChangeMap::value_type*> sortedChanges() const;
+    void printChanges(std::ostream& out) const;
+    void printChange(std::ostream& out, const Change& change) const;
+
+ private:
+    static long long ChangeSize(const std::string& key, const Change& change);
+    static void WriteChange(std::ostream& out, const std::string& key, const Change& change);
+    static bool ReadChange(std::istream& in, std::string& key, Change& change);
+
+ private:
+    const KeyColumns m_key_columns;
+    const long long m_memory_budget;
+
+ private:
+    std::vector<pss> m_tables;
+    std::map<pss,int> m_table_indexes;
+
+ private:
+    ChangeMap m_changes;
+    long long m_memory_usage;
+    long long m_seq;
+
+ private:
+    static const int NUM_OF_PARTITIONS = 16;
+    bool m_spilled;
+    std::vector<Poco::TemporaryFile*> m_spill_files;
+    std::vector<std::ofstream*> m_spill_streams;
+};
+
+#endif // #ifndef COMPACTOR_H_202610191600
@@ -0,0 +1,390 @@
+#include "dumpclient.h"
+#include <Poco/SHA1Engine.h>
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+const unsigned char COM_QUERY = 0x03;
+const unsigned char COM_BINLOG_DUMP = 0x12;
+const unsigned char COM_BINLOG_DUMP_GTID = 0x1e;
+
+const unsigned int CLIENT_LONG_PASSWORD = 0x00000001;
+const unsigned int CLIENT_LONG_FLAG = 0x00000004;
+const unsigned int CLIENT_PROTOCOL_41 = 0x00000200;
+const unsigned int CLIENT_TRANSACTIONS = 0x00002000;
+const unsigned int CLIENT_SECURE_CONNECTION = 0x00008000;
+const unsigned int CLIENT_PLUGIN_AUTH = 0x00080000;
+
+const unsigned short BINLOG_DUMP_NON_BLOCK = 0x01;
+const unsigned short BINLOG_THROUGH_GTID = 0x04;
+
+const char NATIVE_PASSWORD_PLUGIN[] = "mysql_native_password";
+
+void appendInt(string& s, unsigned long long n, int byte_size) {
+    for(int i = 0; i < byte_size; ++i) s += static_cast<char>((n >> (8 * i)) & 0xFF);
+}
+
+unsigned int readInt(const char* data, int byte_size) {
+    unsigned int n = 0;
+    for(int i = byte_size - 1; i >= 0; --i) n = (n << 8) | static_cast<unsigned char>(data[i]);
+    return n;
+}
+
+bool isOk(const char* payload, int payload_size) {
+    return payload_size > 0 && payload[0] == 0x00;
+}
+
+bool isErr(const char* payload, int payload_size) {
+    return payload_size > 0 && static_cast<unsigned char>(payload[0]) == 0xFF;
+}
+
+bool isEof(const char* payload, int payload_size) {
+    return payload_size > 0 && payload_size < 9 && static_cast<unsigned char>(payload[0]) == 0xFE;
+}
+
+}
+
+//******************************
+// BINLOG DUMP CLIENT CLASS
+//******************************
+
+DumpClient::DumpClient():
+    m_fd(-1), m_seq(0), m_buffer(RECV_BUFFER_SIZE), m_begin(0), m_end(0), m_consumed(0)
+{
+}
+
+DumpClient::~DumpClient() {
+    close();
+}
+
+bool DumpClient::connect(const string& host, int port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    stringstream service;
+    service << port << flush;
+
+    struct addrinfo* addrs = NULL;
+    const int rc = getaddrinfo(host.c_str(), service.str().c_str(), &hints, &addrs);
+    if(rc != 0) {
+        cerr << "cannot resolve " << host << ": " << gai_strerror(rc) << endl;
+        return false;
+    }
+    for(struct addrinfo* ai = addrs; ai && m_fd < 0; ai = ai->ai_next) {
+        m_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(m_fd < 0) continue;
+        const int rcvbuf = RECV_BUFFER_SIZE;
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+        if(::connect(m_fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if(m_fd < 0) {
+        cerr << "cannot connect to " << host << ':' << port << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+bool DumpClient::connect(const string& socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof addr.sun_path) {
+        cerr << "socket path too long " << socket_path << endl;
+        return false;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof addr.sun_path - 1);
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_fd < 0 || ::connect(m_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) != 0) {
+        cerr << "cannot connect to " << socket_path << ": " << strerror(errno) << endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void DumpClient::close() {
+    if(m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+}
+
+bool DumpClient::login(const string& user, const string& password) {
+    const char* payload;
+    int payload_size;
+    if(!readPacket(payload, payload_size)) return false;
+    if(isErr(payload, payload_size)) {
+        PrintError(payload, payload_size);
+        return false;
+    }
+    if(payload_size < 1 || payload[0] != 10) {
+        cerr << "unsupported handshake protocol" << endl;
+        return false;
+    }
+
+    // Initial Handshake Packet v10
+    const char* end = payload + payload_size;
+    const char* p = payload + 1;
+    const string server_version(p, strnlen(p, end - p));
+    p += server_version.size() + 1;
+    p += 4;
+    if(p + 8 + 1 + 2 > end) {
+        cerr << "handshake packet too short" << endl;
+        return false;
+    }
+    string scramble(p, 8);
+    p += 8 + 1;
+    unsigned int server_capabilities = readInt(p, 2);
+    p += 2;
+    if(p + 1 + 2 + 2 + 1 + 10 <= end) {
+        p += 1 + 2;
+        server_capabilities |= readInt(p, 2) << 16;
+        p += 2;
+        const int auth_data_size = static_cast<unsigned char>(*p);
+        p += 1 + 10;
+        const int part2_size = max(13, auth_data_size - 8);
+        if(p + part2_size <= end) {
+            scramble.append(p, part2_size - 1);
+            p += part2_size;
+        }
+    }
+    if(!(server_capabilities & CLIENT_PROTOCOL_41)) {
+        cerr << "server does not support protocol 4.1" << endl;
+        return false;
+    }
+
+    const unsigned int capabilities = CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG | CLIENT_PROTOCOL_41 |
+        CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION | (server_capabilities & CLIENT_PLUGIN_AUTH);
+    const string auth_response = ScramblePassword(password, scramble);
+
+    string response;
+    appendInt(response, capabilities, 4);
+    appendInt(response, MAX_PACKET_SIZE, 4);
+    response += static_cast<char>(33);
+    response.append(23, '\0');
+    response += user;
+    response += '\0';
+    response += static_cast<char>(auth_response.size());
+    response += auth_response;
+    if(capabilities & CLIENT_PLUGIN_AUTH) {
+        response += NATIVE_PASSWORD_PLUGIN;
+        response += '\0';
+    }
+    if(!writePacket(response) || !readPacket(payload, payload_size)) return false;
+
+    // Authentication Method Switch Request
+    if(payload_size > 0 && static_cast<unsigned char>(payload[0]) == 0xFE) {
+        const char* plugin = payload + 1;
+        const int plugin_size = strnlen(plugin, payload_size - 1);
+        if(string(plugin, plugin_size) != NATIVE_PASSWORD_PLUGIN) {
+            cerr << "unsupported authentication plugin " << string(plugin, plugin_size) << endl;
+            return false;
+        }
+        string new_scramble(plugin + plugin_size + 1, payload + payload_size);
+        if(!new_scramble.empty() && new_scramble[new_scramble.size() - 1] == '\0')
+            new_scramble.erase(new_scramble.size() - 1);
+        if(!writePacket(ScramblePassword(password, new_scramble)) || !readPacket(payload, payload_size)) return false;
+    }
+
+    if(isErr(payload, payload_size)) {
+        PrintError(payload, payload_size);
+        return false;
+    }
+    if(!isOk(payload, payload_size)) {
+        cerr << "unsupported authentication exchange" << endl;
+        return false;
+    }
+
+    // Declares the client checksum aware. Servers before 5.6 do not know
+    // the variable, and never checksum events; later ones refuse to
+    // stream a checksummed binlog to a client that has not declared it.
+    if(!MySQLBinlog::HasChecksumAlgorithm(server_version.c_str())) return true;
+    if(!query("SET @master_binlog_checksum = @@global.binlog_checksum")) {
+        cerr << "cannot set @master_binlog_checksum on server " << server_version << endl;
+        return false;
+    }
+    return true;
+}
+
+bool DumpClient::dump(const string& binlog_name, int position, int server_id, bool non_block) {
+    string command;
+    command += static_cast<char>(COM_BINLOG_DUMP);
+    appendInt(command, position, 4);
+    appendInt(command, non_block ? BINLOG_DUMP_NON_BLOCK : 0, 2);
+    appendInt(command, server_id, 4);
+    command += binlog_name;
+    m_seq = 0xFF;
+    return writePacket(command);
+}
+
+bool DumpClient::dumpGtid(const GtidSet& executed_gtids, int server_id, bool non_block) {
+    string gtid_data;
+    if(!executed_gtids.encode(gtid_data)) {
+        cerr << "cannot encode GTID set " << executed_gtids.toString() << endl;
+        return false;
+    }
+    string command;
+    command += static_cast<char>(COM_BINLOG_DUMP_GTID);
+    appendInt(command, (non_block ? BINLOG_DUMP_NON_BLOCK : 0) | BINLOG_THROUGH_GTID, 2);
+    appendInt(command, server_id, 4);
+    appendInt(command, 0, 4);
+    appendInt(command, 4, 8);
+    appendInt(command, gtid_data.size(), 4);
+    command += gtid_data;
+    m_seq = 0xFF;
+    return writePacket(command);
+}
+
+bool DumpClient::next(const char*& event, int& event_size) {
+    const char* payload;
+    int payload_size;
+    if(!readPacket(payload, payload_size)) return false;
+    if(isEof(payload, payload_size)) return false;
+    if(isErr(payload, payload_size)) {
+        PrintError(payload, payload_size);
+        return false;
+    }
+    if(!isOk(payload, payload_size)) {
+        cerr << "unexpected packet in binlog stream" << endl;
+        return false;
+    }
+    event = payload + 1;
+    event_size = payload_size - 1;
+    return true;
+}
+
+bool DumpClient::query(const string& sql) {
+    string command;
+    command += static_cast<char>(COM_QUERY);
+    command += sql;
+    m_seq = 0xFF;
+    return writePacket(command) && readOk("COM_QUERY");
+}
+
+bool DumpClient::readOk(const char* command) {
+    const char* payload;
+    int payload_size;
+    if(!readPacket(payload, payload_size)) return false;
+    if(isErr(payload, payload_size)) {
+        PrintError(payload, payload_size);
+        return false;
+    }
+    if(!isOk(payload, payload_size)) {
+        cerr << "unexpected reply to " << command << endl;
+        return false;
+    }
+    return true;
+}
+
+// Packets larger than 16 MiB arrive split into several; they are the only
+// ones copied out of the receive buffer.
+bool DumpClient::readPacket(const char*& payload, int& payload_size) {
+    m_begin += m_consumed;
+    m_consumed = 0;
+    m_large_packet.clear();
+
+    for(;;) {
+        const int HEADER_SIZE = 4;
+        if(!fill(HEADER_SIZE)) return false;
+        const int size = readInt(&m_buffer[m_begin], 3);
+        m_seq = static_cast<unsigned char>(m_buffer[m_begin + 3]);
+        if(!fill(HEADER_SIZE + size)) return false;
+
+        if(size < MAX_PACKET_SIZE && m_large_packet.empty()) {
+            payload = &m_buffer[m_begin + HEADER_SIZE];
+            payload_size = size;
+            m_consumed = HEADER_SIZE + size;
+            return true;
+        }
+
+        m_large_packet.append(&m_buffer[m_begin + HEADER_SIZE], size);
+        m_begin += HEADER_SIZE + size;
+        if(size < MAX_PACKET_SIZE) {
+            payload = m_large_packet.data();
+            payload_size = m_large_packet.size();
+            return true;
+        }
+    }
+}
+
+bool DumpClient::fill(size_t byte_size) {
+    if(m_end - m_begin >= byte_size) return true;
+    if(m_buffer.size() - m_begin < byte_size) {
+        copy(m_buffer.begin() + m_begin, m_buffer.begin() + m_end, m_buffer.begin());
+        m_end -= m_begin;
+        m_begin = 0;
+        if(m_buffer.size() < byte_size) m_buffer.resize(byte_size);
+    }
+    while(m_end - m_begin < byte_size) {
+        const ssize_t n = recv(m_fd, &m_buffer[m_end], m_buffer.size() - m_end, 0);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            if(n < 0) cerr << "receive failed: " << strerror(errno) << endl;
+            else cerr << "connection closed by server" << endl;
+            return false;
+        }
+        m_end += n;
+    }
+    return true;
+}
+
+bool DumpClient::writePacket(const string& payload) {
+    string packet;
+    appendInt(packet, payload.size(), 3);
+    packet += static_cast<char>(++m_seq);
+    packet += payload;
+
+    size_t sent = 0;
+    while(sent < packet.size()) {
+        const ssize_t n = send(m_fd, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            cerr << "send failed: " << strerror(errno) << endl;
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// mysql_native_password: SHA1(password) XOR SHA1(scramble + SHA1(SHA1(password)))
+string DumpClient::ScramblePassword(const string& password, const string& scramble) {
+    if(password.empty()) return string();
+
+    Poco::SHA1Engine sha1;
+    sha1.update(password);
+    const Poco::DigestEngine::Digest stage1 = sha1.digest();
+    sha1.update(&stage1[0], stage1.size());
+    const Poco::DigestEngine::Digest stage2 = sha1.digest();
+    sha1.update(scramble);
+    sha1.update(&stage2[0], stage2.size());
+    const Poco::DigestEngine::Digest stage3 = sha1.digest();
+
+    string token(stage1.size(), '\0');
+    for(size_t i = 0; i < stage1.size(); ++i) token[i] = static_cast<char>(stage1[i] ^ stage3[i]);
+    return token;
+}
+
+void DumpClient::PrintError(const char* payload, int payload_size) {
+    if(payload_size < 3) {
+        cerr << "server error" << endl;
+        return;
+    }
+    const int code = readInt(payload + 1, 2);
+    int pos = 3;
+    if(payload_size >= 9 && payload[pos] == '#') pos += 6;
+    cerr << "server error " << code << ": " << string(payload + pos, payload + payload_size) << endl;
+}
@@ -0,0 +1,57 @@
+#ifndef DUMPCLIENT_H_202610191800
+#define DUMPCLIENT_H_202610191800
+
+#include "mysqlbinlog.h"
+#include <string>
+#include <vector>
+
+// Speaks just enough of the MySQL client/server protocol to log in and
+// request a binlog stream with COM_BINLOG_DUMP or COM_BINLOG_DUMP_GTID.
+// Events are handed to MySQLBinlog straight out of the receive buffer.
+// The buffer is refilled only when the next event is asked for, so a slow
+// consumer closes the TCP window and throttles the server instead of
+// growing memory.
+class DumpClient: public EventSource {
+ public:
+    DumpClient();
+    ~DumpClient();
+
+ public:
+    bool connect(const std::string& host, int port);
+    bool connect(const std::string& socket_path);
+    bool login(const std::string& user, const std::string& password);
+    bool dump(const std::string& binlog_name, int position, int server_id, bool non_block);
+    bool dumpGtid(const GtidSet& executed_gtids, int server_id, bool non_block);
+    void close();
+
+ public:
+    virtual bool next(const char*& event, int& event_size);
+
+ private:
+    bool query(const std::string& sql);
+    bool readPacket(const char*& payload, int& payload_size);
+    bool writePacket(const std::string& payload);
+    bool fill(size_t byte_size);
+    bool readOk(const char* command);
+
+ private:
+    static std::string ScramblePassword(const std::string& password, const std::string& scramble);
+    static void PrintError(const char* payload, int payload_size);
+
+ private:
+    static const size_t RECV_BUFFER_SIZE = 1 << 20;
+    static const int MAX_PACKET_SIZE = 0xFFFFFF;
+
+ private:
+    int m_fd;
+    unsigned char m_seq;
+
+ private:
+    std::vector<char> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    size_t m_consumed;
+    std::string m_large_packet;
+};
+
+#endif // #ifndef DUMPCLIENT_H_202610191800
@@ -0,0 +1,295 @@
+// Stand-in for a MySQL server that answers binlog dump requests by replaying
+// binlog files over a unix socket, so --socket can be exercised without a
+// running server. It accepts any login and serves one client at a time.
+//
+//   fakeserver /tmp/fake.sock mysql-bin.000001 [mysql-bin.000002 ...]
+//   mysqlbinlog2 --socket=/tmp/fake.sock mysql-bin.000001
+#include "gtid.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+const unsigned char COM_QUIT = 0x01;
+const unsigned char COM_QUERY = 0x03;
+const unsigned char COM_BINLOG_DUMP = 0x12;
+const unsigned char COM_REGISTER_SLAVE = 0x15;
+const unsigned char COM_BINLOG_DUMP_GTID = 0x1e;
+
+const int HEADER_SIZE = 19;
+const int TYPE_CODE_OFFSET = 4;
+const int EVENT_LENGTH_OFFSET = 9;
+const unsigned char ROTATE_EVENT = 4;
+const unsigned char STOP_EVENT = 3;
+const unsigned char GTID_LOG_EVENT = 33;
+const unsigned char ANONYMOUS_GTID_LOG_EVENT = 34;
+const int LOG_EVENT_ARTIFICIAL_F = 0x20;
+const int MAX_PACKET_SIZE = 0xFFFFFF;
+const int SERVER_ID = 1;
+
+void appendInt(string& s, unsigned long long n, int byte_size) {
+    for(int i = 0; i < byte_size; ++i) s += static_cast<char>((n >> (8 * i)) & 0xFF);
+}
+
+unsigned long long readInt(const char* data, int byte_size) {
+    unsigned long long n = 0;
+    for(int i = byte_size - 1; i >= 0; --i) n = (n << 8) | static_cast<unsigned char>(data[i]);
+    return n;
+}
+
+class Connection {
+ public:
+    explicit Connection(int fd): m_fd(fd), m_seq(0) {}
+    ~Connection() { ::close(m_fd); }
+
+ public:
+    bool readPacket(string& payload) {
+        payload.clear();
+        for(;;) {
+            char header[4];
+            if(!readAll(header, sizeof header)) return false;
+            const int size = readInt(header, 3);
+            m_seq = static_cast<unsigned char>(header[3]);
+            const size_t offset = payload.size();
+            payload.resize(offset + size);
+            if(size > 0 && !readAll(&payload[offset], size)) return false;
+            if(size < MAX_PACKET_SIZE) return true;
+        }
+    }
+
+    bool writePacket(const string& payload) {
+        size_t offset = 0;
+        for(;;) {
+            const size_t size = min(payload.size() - offset, static_cast<size_t>(MAX_PACKET_SIZE));
+            string packet;
+            appendInt(packet, size, 3);
+            packet += static_cast<char>(++m_seq);
+            packet.append(payload, offset, size);
+            if(!writeAll(packet.data(), packet.size())) return false;
+            offset += size;
+            if(size < static_cast<size_t>(MAX_PACKET_SIZE)) return true;
+        }
+    }
+
+    bool writeOk() {
+        return writePacket(string("\x00\x00\x00\x02\x00\x00\x00", 7));
+    }
+
+    bool writeEof() {
+        return writePacket(string("\xfe\x00\x00\x02\x00", 5));
+    }
+
+ private:
+    bool readAll(char* dst, size_t size) {
+        while(size > 0) {
+            const ssize_t n = recv(m_fd, dst, size, 0);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0) return false;
+            dst += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool writeAll(const char* src, size_t size) {
+        while(size > 0) {
+            const ssize_t n = send(m_fd, src, size, MSG_NOSIGNAL);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0) return false;
+            src += n;
+            size -= n;
+        }
+        return true;
+    }
+
+ private:
+    int m_fd;
+    unsigned char m_seq;
+};
+
+string baseName(const string& path) {
+    const string::size_type slash = path.rfind('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+bool decodeGtidSet(const string& data, GtidSet& gtids) {
+    size_t pos = 0;
+    if(data.size() < 8) return false;
+    const unsigned long long n_sids = readInt(data.data(), 8);
+    pos += 8;
+    for(unsigned long long i = 0; i < n_sids; ++i) {
+        if(pos + 16 + 8 > data.size()) return false;
+        const string sid = GtidSet::FormatSid(data.data() + pos);
+        const unsigned long long n_intervals = readInt(data.data() + pos + 16, 8);
+        pos += 16 + 8;
+        for(unsigned long long j = 0; j < n_intervals; ++j) {
+            if(pos + 16 > data.size()) return false;
+            gtids.addInterval(sid, readInt(data.data() + pos, 8), readInt(data.data() + pos + 8, 8));
+            pos += 16;
+        }
+    }
+    return true;
+}
+
+string artificialRotate(const string& binlog_name, unsigned long long position) {
+    string event;
+    appendInt(event, 0, 4);
+    event += static_cast<char>(ROTATE_EVENT);
+    appendInt(event, SERVER_ID, 4);
+    appendInt(event, HEADER_SIZE + 8 + binlog_name.size(), 4);
+    appendInt(event, 0, 4);
+    appendInt(event, LOG_EVENT_ARTIFICIAL_F, 2);
+    appendInt(event, position, 8);
+    event += binlog_name;
+    return event;
+}
+
+// Replays files[first..] from position, skipping the transactions whose GTID
+// is in executed_gtids, and ends the stream with an EOF packet.
+bool replay(Connection& conn, const vector<string>& files, size_t first,
+            unsigned long long position, const GtidSet& executed_gtids) {
+    for(size_t i = first; i < files.size(); ++i, position = 4) {
+        ifstream src(files[i].c_str(), ios::in | ios::binary);
+        if(!src.is_open()) {
+            cerr << "file open failed " << files[i] << endl;
+            return false;
+        }
+        if(!conn.writePacket(string(1, '\0') + artificialRotate(baseName(files[i]), position))) return false;
+
+        bool skipping = false;
+        unsigned long long offset = 4;
+        src.seekg(offset);
+        for(;;) {
+            char header[HEADER_SIZE];
+            if(!src.read(header, HEADER_SIZE)) break;
+            const unsigned long long length = readInt(header + EVENT_LENGTH_OFFSET, 4);
+            if(length < static_cast<unsigned long long>(HEADER_SIZE)) break;
+            string payload(1, '\0');
+            payload.append(header, HEADER_SIZE);
+            payload.resize(1 + length);
+            if(!src.read(&payload[1 + HEADER_SIZE], length - HEADER_SIZE)) break;
+
+            // FORMAT_DESCRIPTION_EVENT is always sent, the rest from position
+            const bool is_format_description = offset == 4;
+            offset += length;
+            if(!is_format_description && offset - length < position) continue;
+
+            const unsigned char type = header[TYPE_CODE_OFFSET];
+            if(GTID_LOG_EVENT == type)
+                skipping = executed_gtids.contains(GtidSet::FormatSid(&payload[1 + HEADER_SIZE + 1]),
+                                                   readInt(&payload[1 + HEADER_SIZE + 1 + 16], 8));
+            else if(ANONYMOUS_GTID_LOG_EVENT == type || ROTATE_EVENT == type || STOP_EVENT == type)
+                skipping = false;
+            if(skipping) continue;
+
+            if(!conn.writePacket(payload)) return false;
+        }
+    }
+    return conn.writeEof();
+}
+
+bool serve(Connection& conn, const vector<string>& files) {
+    string handshake;
+    handshake += static_cast<char>(10);
+    handshake += "5.6.99-fakeserver";
+    handshake += '\0';
+    appendInt(handshake, 1, 4);
+    handshake += "01234567";
+    handshake += '\0';
+    appendInt(handshake, 0xF7FF, 2);
+    handshake += static_cast<char>(33);
+    appendInt(handshake, 0x0002, 2);
+    appendInt(handshake, 0x0008, 2);
+    handshake += static_cast<char>(21);
+    handshake.append(10, '\0');
+    handshake += "89abcdefghij";
+    handshake += '\0';
+    handshake += "mysql_native_password";
+    handshake += '\0';
+
+    string payload;
+    if(!conn.writePacket(handshake) || !conn.readPacket(payload) || !conn.writeOk()) return false;
+
+    while(conn.readPacket(payload)) {
+        if(payload.empty()) return false;
+        const unsigned char command = payload[0];
+
+        if(COM_QUIT == command) return true;
+
+        if(COM_QUERY == command || COM_REGISTER_SLAVE == command) {
+            if(!conn.writeOk()) return false;
+        }
+        else if(COM_BINLOG_DUMP == command && payload.size() >= 11) {
+            const unsigned long long position = readInt(&payload[1], 4);
+            const string binlog_name = payload.substr(11);
+            size_t first = 0;
+            while(first < files.size() && baseName(files[first]) != binlog_name) ++first;
+            if(first == files.size()) {
+                conn.writePacket(string("\xff\xd4\x04#HY000") + "Could not find first log file name in binary log index file");
+                return false;
+            }
+            return replay(conn, files, first, position, GtidSet());
+        }
+        else if(COM_BINLOG_DUMP_GTID == command && payload.size() >= 11) {
+            const size_t name_size = readInt(&payload[7], 4);
+            const size_t data_offset = 11 + name_size + 8 + 4;
+            GtidSet executed_gtids;
+            if(payload.size() < data_offset || !decodeGtidSet(payload.substr(data_offset), executed_gtids)) {
+                cerr << "malformed COM_BINLOG_DUMP_GTID" << endl;
+                return false;
+            }
+            return replay(conn, files, 0, 4, executed_gtids);
+        }
+        else {
+            cerr << "unsupported command " << static_cast<int>(command) << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, const char* argv[]) {
+
+    if (argc < 3) {
+        cerr << "usage: fakeserver SOCKET mysql-bin.000001 [mysql-bin.000002 ...]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    const vector<string> files(argv + 2, argv + argc);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[1], sizeof addr.sun_path - 1);
+    unlink(argv[1]);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) != 0 ||
+        listen(listen_fd, 1) != 0) {
+        cerr << "cannot listen on " << argv[1] << ": " << strerror(errno) << endl;
+        return EXIT_FAILURE;
+    }
+
+    for(;;) {
+        const int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            cerr << "accept failed: " << strerror(errno) << endl;
+            return EXIT_FAILURE;
+        }
+        Connection conn(fd);
+        serve(conn, files);
+    }
+}
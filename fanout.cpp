@@ -0,0 +1,326 @@
+#include "fanout.h"
+#include <Poco/Exception.h>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+const uint32_t FANOUT_MAGIC = 0x4e41464d; // "MFAN"
+const uint32_t FANOUT_VERSION = 1;
+const uint32_t PADDING_RECORD = 0xFFFFFFFF;
+
+enum SlotState {
+    SLOT_FREE = 0,
+    SLOT_JOINING = 1,
+    SLOT_ACTIVE = 2,
+    SLOT_DROPPED = 3
+};
+
+uint64_t align8(uint64_t size) {
+    return (size + 7) & ~static_cast<uint64_t>(7);
+}
+
+size_t dataOffset(uint32_t max_consumers) {
+    return align8(sizeof(FanoutHeader) + max_consumers * sizeof(FanoutSlot));
+}
+
+bool isAlive(uint32_t pid) {
+    return pid == 0 || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// polls start short so a consumer keeping up sees records promptly, and
+// back off while the ring stays idle
+void backoff(useconds_t& delay) {
+    usleep(delay);
+    if(delay < 10000) delay *= 2;
+}
+
+}
+
+//******************************
+// FANOUT PUBLISHER CLASS
+//******************************
+
+FanoutPublisher::FanoutPublisher():
+    m_memory(NULL), m_header(NULL), m_slots(NULL), m_data(NULL), m_drop_slow_consumers(false)
+{
+}
+
+FanoutPublisher::~FanoutPublisher() {
+    close();
+}
+
+bool FanoutPublisher::open(const string& name, long long capacity, int max_consumers, bool drop_slow_consumers) {
+    // a power of two keeps offsets aligned however far head has come
+    if(capacity < 4096 || (capacity & (capacity - 1)) != 0) {
+        cerr << "ring size must be a power of two of at least 4096 bytes" << endl;
+        return false;
+    }
+    if(max_consumers <= 0) {
+        cerr << "max consumers must be positive" << endl;
+        return false;
+    }
+
+    close();
+    const size_t offset = dataOffset(max_consumers);
+    try {
+        m_memory = new Poco::SharedMemory(name, offset + capacity, Poco::SharedMemory::AM_WRITE);
+    }
+    catch(const Poco::Exception& e) {
+        cerr << "cannot create shared memory " << name << ": " << e.displayText() << endl;
+        return false;
+    }
+
+    m_header = reinterpret_cast<FanoutHeader*>(m_memory->begin());
+    m_slots = reinterpret_cast<FanoutSlot*>(m_memory->begin() + sizeof(FanoutHeader));
+    m_data = m_memory->begin() + offset;
+    m_drop_slow_consumers = drop_slow_consumers;
+
+    // a segment left behind by a crashed daemon is reset; consumers still
+    // attached to it see a new writer pid and give up
+    __atomic_store_n(&m_header->magic, 0, __ATOMIC_SEQ_CST);
+    memset(m_memory->begin() + sizeof(uint32_t), 0, offset - sizeof(uint32_t));
+    m_header->version = FANOUT_VERSION;
+    m_header->capacity = capacity;
+    m_header->max_consumers = max_consumers;
+    m_header->writer_pid = getpid();
+    __atomic_store_n(&m_header->magic, FANOUT_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool FanoutPublisher::publish(int type, int timestamp, const char* data, int size) {
+    const uint64_t capacity = m_header->capacity;
+    const uint64_t record_size = sizeof(FanoutRecord) + align8(size);
+    if(record_size > capacity / 4) {
+        cerr << "event of " << size << " bytes does not fit in the ring" << endl;
+        return false;
+    }
+
+    uint64_t head = m_header->head;
+    const uint64_t offset = head & (capacity - 1);
+    const uint64_t padding = capacity - offset < record_size ? capacity - offset : 0;
+    reserve(padding + record_size);
+
+    if(padding >= sizeof(FanoutRecord)) {
+        FanoutRecord* record = reinterpret_cast<FanoutRecord*>(m_data + offset);
+        record->size = 0;
+        record->type = PADDING_RECORD;
+    }
+    head += padding;
+
+    FanoutRecord* record = reinterpret_cast<FanoutRecord*>(m_data + (head & (capacity - 1)));
+    record->size = size;
+    record->type = type;
+    record->timestamp = timestamp;
+    record->reserved = 0;
+    memcpy(record + 1, data, size);
+    __atomic_store_n(&m_header->head, head + record_size, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Makes room for size more bytes: every active consumer must be at most
+// capacity - size bytes behind head. Slow consumers are waited for or
+// dropped, and those whose process has gone are freed.
+void FanoutPublisher::reserve(uint64_t size) {
+    const uint64_t capacity = m_header->capacity;
+    const uint64_t head = m_header->head;
+    useconds_t delay = 50;
+    for(;;) {
+        bool waiting = false;
+        for(uint32_t i = 0; i < m_header->max_consumers; ++i) {
+            FanoutSlot& slot = m_slots[i];
+            uint32_t state = __atomic_load_n(&slot.state, __ATOMIC_ACQUIRE);
+            if(state != SLOT_ACTIVE) continue;
+            if(head + size - __atomic_load_n(&slot.cursor, __ATOMIC_ACQUIRE) <= capacity) continue;
+
+            const uint32_t next_state = !isAlive(slot.pid) ? SLOT_FREE :
+                                        m_drop_slow_consumers ? SLOT_DROPPED : SLOT_ACTIVE;
+            if(next_state == SLOT_ACTIVE) {
+                waiting = true;
+                continue;
+            }
+            // the consumer may have left or caught up meanwhile; either way
+            // the slot no longer holds the writer back
+            __atomic_compare_exchange_n(&slot.state, &state, next_state, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        }
+        if(!waiting) return;
+        backoff(delay);
+    }
+}
+
+void FanoutPublisher::close() {
+    if(!m_memory) return;
+    __atomic_store_n(&m_header->closed, 1, __ATOMIC_RELEASE);
+    // the name goes away with the segment; consumers already attached keep
+    // their mapping and drain what is left
+    delete m_memory;
+    m_memory = NULL;
+    m_header = NULL;
+    m_slots = NULL;
+    m_data = NULL;
+}
+
+//******************************
+// FANOUT OUTPUT CLASS
+//******************************
+
+FanoutOutput::FanoutOutput(ostream& out, FanoutPublisher& publisher):
+    m_out(out), m_out_buf(out.rdbuf()), m_publisher(publisher)
+{
+    m_out.rdbuf(m_pending.rdbuf());
+}
+
+FanoutOutput::~FanoutOutput() {
+    m_out.rdbuf(m_out_buf);
+}
+
+bool FanoutOutput::publish(int type, int timestamp) {
+    const string text = m_pending.str();
+    m_pending.str("");
+    return m_publisher.publish(type, timestamp, text.data(), text.size());
+}
+
+//******************************
+// FANOUT CONSUMER CLASS
+//******************************
+
+FanoutConsumer::FanoutConsumer():
+    m_memory(NULL), m_header(NULL), m_slot(NULL), m_data(NULL), m_cursor(0), m_dropped(false)
+{
+}
+
+FanoutConsumer::~FanoutConsumer() {
+    close();
+}
+
+bool FanoutConsumer::open(const string& name) {
+    close();
+    uint32_t max_consumers;
+    uint64_t capacity;
+    try {
+        // the header tells how large the whole segment is
+        Poco::SharedMemory header_memory(name, sizeof(FanoutHeader), Poco::SharedMemory::AM_READ, 0, false);
+        const FanoutHeader* header = reinterpret_cast<const FanoutHeader*>(header_memory.begin());
+        if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FANOUT_MAGIC ||
+           header->version != FANOUT_VERSION) {
+            cerr << "shared memory " << name << " is not a binlog ring" << endl;
+            return false;
+        }
+        max_consumers = header->max_consumers;
+        capacity = header->capacity;
+        m_memory = new Poco::SharedMemory(name, dataOffset(max_consumers) + capacity,
+                                          Poco::SharedMemory::AM_WRITE, 0, false);
+    }
+    catch(const Poco::Exception& e) {
+        cerr << "cannot open shared memory " << name << ": " << e.displayText() << endl;
+        return false;
+    }
+
+    m_header = reinterpret_cast<FanoutHeader*>(m_memory->begin());
+    m_data = m_memory->begin() + dataOffset(max_consumers);
+    FanoutSlot* slots = reinterpret_cast<FanoutSlot*>(m_memory->begin() + sizeof(FanoutHeader));
+
+    // take a free slot, or one whose consumer died without leaving
+    for(uint32_t i = 0; i < max_consumers && !m_slot; ++i) {
+        uint32_t state = __atomic_load_n(&slots[i].state, __ATOMIC_ACQUIRE);
+        if(state != SLOT_FREE && isAlive(slots[i].pid)) continue;
+        if(__atomic_compare_exchange_n(&slots[i].state, &state, SLOT_JOINING, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) m_slot = &slots[i];
+    }
+    if(!m_slot) {
+        cerr << "shared memory " << name << " has no free consumer slot" << endl;
+        close();
+        return false;
+    }
+
+    // a new consumer starts at the next record published; head is
+    // re-read after going active so a record overwritten meanwhile is
+    // caught by the check in next()
+    m_slot->pid = getpid();
+    m_cursor = __atomic_load_n(&m_header->head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&m_slot->cursor, m_cursor, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_slot->state, SLOT_ACTIVE, __ATOMIC_SEQ_CST);
+    m_dropped = false;
+    return true;
+}
+
+// Waits for the next record and copies it out. Returns false once the
+// writer has closed the ring and every record was read, when the writer
+// died, or when this consumer was dropped.
+bool FanoutConsumer::next(string& text, int& type, int& timestamp) {
+    if(!m_slot || m_dropped) return false;
+    const uint64_t capacity = m_header->capacity;
+    const uint32_t writer_pid = m_header->writer_pid;
+    useconds_t delay = 50;
+    for(;;) {
+        if(__atomic_load_n(&m_slot->state, __ATOMIC_ACQUIRE) != SLOT_ACTIVE) {
+            m_dropped = true;
+            return false;
+        }
+
+        const uint64_t head = __atomic_load_n(&m_header->head, __ATOMIC_ACQUIRE);
+        if(m_cursor == head) {
+            if(__atomic_load_n(&m_header->closed, __ATOMIC_ACQUIRE) &&
+               __atomic_load_n(&m_header->head, __ATOMIC_ACQUIRE) == m_cursor) return false;
+            if(m_header->writer_pid != writer_pid || !isAlive(writer_pid)) {
+                cerr << "ring writer " << writer_pid << " has gone" << endl;
+                return false;
+            }
+            backoff(delay);
+            continue;
+        }
+        delay = 50;
+        if(head - m_cursor > capacity) {
+            m_dropped = true;
+            return false;
+        }
+
+        const uint64_t offset = m_cursor & (capacity - 1);
+        if(capacity - offset < sizeof(FanoutRecord)) {
+            m_cursor += capacity - offset;
+            continue;
+        }
+        FanoutRecord record;
+        memcpy(&record, m_data + offset, sizeof(record));
+        if(record.type == PADDING_RECORD) {
+            m_cursor += capacity - offset;
+            continue;
+        }
+        if(record.size > capacity - offset - sizeof(record)) {
+            m_dropped = true;
+            return false;
+        }
+        text.assign(m_data + offset + sizeof(record), record.size);
+
+        // the copy is good only if the writer did not lap this record while
+        // it was being made
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&m_slot->state, __ATOMIC_ACQUIRE) != SLOT_ACTIVE ||
+           __atomic_load_n(&m_header->head, __ATOMIC_ACQUIRE) - m_cursor > capacity) {
+            m_dropped = true;
+            return false;
+        }
+
+        type = record.type;
+        timestamp = record.timestamp;
+        m_cursor += sizeof(record) + align8(record.size);
+        __atomic_store_n(&m_slot->cursor, m_cursor, __ATOMIC_RELEASE);
+        return true;
+    }
+}
+
+void FanoutConsumer::close() {
+    if(m_slot) {
+        __atomic_store_n(&m_slot->state, SLOT_FREE, __ATOMIC_SEQ_CST);
+        m_slot = NULL;
+    }
+    delete m_memory;
+    m_memory = NULL;
+    m_header = NULL;
+    m_data = NULL;
+}
@@ -0,0 +1,109 @@
+#ifndef FANOUT_H_202610192200
+#define FANOUT_H_202610192200
+
+#include <Poco/SharedMemory.h>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+
+// Decoded events published once into a POSIX shared-memory ring and read by
+// any number of local consumers, each with its own cursor.
+//
+// The segment starts with a FanoutHeader and max_consumers FanoutSlots,
+// followed by capacity bytes of records. A record is a FanoutRecord header
+// and the event text padded to 8 bytes; records never wrap, the writer
+// skips to the start of the ring instead. head counts every byte ever
+// published, so a cursor is also a count and head - cursor is the lag.
+//
+// A consumer more than capacity bytes behind would lose records. The
+// writer then either waits for it (memory stays bounded, the consumer
+// lags) or drops it, and the consumer's next read fails.
+struct FanoutHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t max_consumers;
+    uint32_t writer_pid;
+    uint64_t head;
+    uint32_t closed;
+    uint32_t reserved;
+};
+
+struct FanoutSlot {
+    uint64_t cursor;
+    uint32_t state;
+    uint32_t pid;
+};
+
+struct FanoutRecord {
+    uint32_t size;
+    uint32_t type;
+    uint32_t timestamp;
+    uint32_t reserved;
+};
+
+class FanoutPublisher {
+ public:
+    FanoutPublisher();
+    ~FanoutPublisher();
+
+ public:
+    bool open(const std::string& name, long long capacity, int max_consumers, bool drop_slow_consumers);
+    bool publish(int type, int timestamp, const char* data, int size);
+    void close();
+
+ private:
+    void reserve(uint64_t size);
+
+ private:
+    Poco::SharedMemory* m_memory;
+    FanoutHeader* m_header;
+    FanoutSlot* m_slots;
+    char* m_data;
+    bool m_drop_slow_consumers;
+};
+
+// Redirects a stream for as long as it lives; publish() sends what was
+// written to it since the last call as one record.
+class FanoutOutput {
+ public:
+    FanoutOutput(std::ostream& out, FanoutPublisher& publisher);
+    ~FanoutOutput();
+
+ public:
+    bool publish(int type, int timestamp);
+    bool empty() const {
+        return m_pending.rdbuf()->in_avail() <= 0;
+    };
+
+ private:
+    std::ostream& m_out;
+    std::streambuf* const m_out_buf;
+    FanoutPublisher& m_publisher;
+    std::stringstream m_pending;
+};
+
+class FanoutConsumer {
+ public:
+    FanoutConsumer();
+    ~FanoutConsumer();
+
+ public:
+    bool open(const std::string& name);
+    bool next(std::string& text, int& type, int& timestamp);
+    bool dropped() const {
+        return m_dropped;
+    };
+    void close();
+
+ private:
+    Poco::SharedMemory* m_memory;
+    FanoutHeader* m_header;
+    FanoutSlot* m_slot;
+    const char* m_data;
+    uint64_t m_cursor;
+    bool m_dropped;
+};
+
+#endif // #ifndef FANOUT_H_202610192200
@@ -0,0 +1,34 @@
+// Consumer of a ring published with mysqlbinlog2 --publish=NAME: prints each
+// decoded event as it arrives, starting from the next one published, until
+// the publisher exits. Exits with failure when the consumer is dropped.
+//
+//   mysqlbinlog2 --publish=binlog --stop-never --socket=/tmp/mysql.sock mysql-bin.000001
+//   fanoutcat binlog
+#include "fanout.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+using namespace std;
+
+int main(int argc, const char* argv[]) {
+
+    if (argc != 2) {
+        cerr << "usage: fanoutcat NAME" << endl;
+        return EXIT_FAILURE;
+    }
+
+    FanoutConsumer consumer;
+    if (!consumer.open(argv[1])) return EXIT_FAILURE;
+
+    string text;
+    int type;
+    int timestamp;
+    while(consumer.next(text, type, timestamp)) cout << text;
+    cout << flush;
+
+    if (consumer.dropped()) {
+        cerr << "dropped by the publisher for falling behind" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
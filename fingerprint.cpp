@@ -0,0 +1,298 @@
+#include "fingerprint.h"
+#include "util.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace {
+
+enum CharClass {
+    CC_OTHER, CC_SPACE, CC_WORD, CC_DIGIT, CC_QUOTE
+};
+
+struct CharClassTable {
+    unsigned char classes[256];
+    CharClassTable() {
+        for(int c = 0; c < 256; ++c) {
+            if(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v') classes[c] = CC_SPACE;
+            else if(c >= '0' && c <= '9') classes[c] = CC_DIGIT;
+            else if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || c >= 0x80) classes[c] = CC_WORD;
+            else if(c == '\'' || c == '"') classes[c] = CC_QUOTE;
+            else classes[c] = CC_OTHER;
+        }
+    }
+};
+
+const CharClassTable CHAR_CLASSES;
+
+const int MAX_PAREN_DEPTH = 64;
+
+inline int charClass(char c) {
+    return CHAR_CLASSES.classes[static_cast<unsigned char>(c)];
+}
+
+inline bool isWordChar(char c) {
+    const int cc = charClass(c);
+    return CC_WORD == cc || CC_DIGIT == cc;
+}
+
+// Finds the next quote or backslash of a string literal, 16 bytes at a time
+// where SSE2 is available; literals are where long statements spend their bytes.
+const char* findQuoteOrEscape(const char* p, const char* end, char quote) {
+#ifdef __SSE2__
+    const __m128i quotes = _mm_set1_epi8(quote);
+    const __m128i escapes = _mm_set1_epi8('\\');
+    while(end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quotes),
+                                                        _mm_cmpeq_epi8(chunk, escapes)));
+        if(mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while(p < end && *p != quote && *p != '\\') ++p;
+    return p;
+}
+
+const char* skipStringLiteral(const char* p, const char* end) {
+    const char quote = *p++;
+    for(;;) {
+        p = findQuoteOrEscape(p, end, quote);
+        if(p >= end) return end;
+        if(*p == '\\') {
+            p += 2;
+            continue;
+        }
+        ++p;
+        if(p < end && *p == quote) {
+            ++p;
+            continue;
+        }
+        return p;
+    }
+}
+
+const char* skipLine(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol ? eol + 1 : end;
+}
+
+const char* skipBlockComment(const char* p, const char* end) {
+    for(p += 2; p < end; ++p) {
+        p = static_cast<const char*>(memchr(p, '*', end - p));
+        if(!p) return end;
+        if(p + 1 < end && p[1] == '/') return p + 2;
+    }
+    return end;
+}
+
+// true for "?", "?, ?", "?, ?, ?" ...
+bool isPlaceholderList(const char* p, const char* end) {
+    for(;;) {
+        if(p == end || *p != '?') return false;
+        if(++p == end) return true;
+        if(end - p < 2 || p[0] != ',' || p[1] != ' ') return false;
+        p += 2;
+    }
+}
+
+// Only the lists of IN and VALUES vary in length between executions of
+// one statement; "varchar(?)" or "limit (?)" keep their single placeholder.
+bool isVariableList(const char* begin, const char* open) {
+    const char* p = open;
+    if(p > begin && p[-1] == ' ') --p;
+    const char* word = p;
+    while(word > begin && isWordChar(word[-1])) --word;
+    const size_t size = p - word;
+    if((size == 2 && memcmp(word, "in", 2) == 0) ||
+       (size == 5 && memcmp(word, "value", 5) == 0) ||
+       (size == 6 && memcmp(word, "values", 6) == 0)) return true;
+    return p - begin >= 4 && memcmp(p - 4, "?+),", 4) == 0;
+}
+
+}
+
+//******************************
+// STATEMENT FINGERPRINT CLASS
+//******************************
+
+Fingerprinter::Fingerprinter() {
+}
+
+bool Fingerprinter::scan(const char* src_file) {
+    MySQLBinlog parser;
+    if(!parser.open(src_file)) {
+        cerr << "file open failed " << src_file << endl;
+        return false;
+    }
+
+    while(parser.readEventHeader()) {
+        if(QUERY_EVENT != parser.getTypeCode()) continue;
+        if(!parser.readEventData()) break;
+        int sql_statement_size;
+        const char* sql_statement = Event::ReadSQLStatement(parser.getData(), parser.getDataSize(), sql_statement_size);
+        if(sql_statement) add(sql_statement, sql_statement_size, parser.getTimestamp());
+    }
+
+    parser.close();
+    return true;
+}
+
+void Fingerprinter::add(const char* sql_statement, int sql_statement_size, int timestamp) {
+    // collapsing "(?)" into "(?+)" is the only rewrite that grows the text
+    const size_t capacity = 2 * static_cast<size_t>(sql_statement_size) + 4;
+    if(m_buffer.size() < capacity) m_buffer.resize(capacity);
+
+    const int size = Normalize(sql_statement, sql_statement_size, &m_buffer[0]);
+    const unsigned long long hash = Hash(&m_buffer[0], size);
+
+    unordered_map<unsigned long long, Class>::iterator it = m_classes.find(hash);
+    if(it == m_classes.end()) {
+        Class& c = m_classes[hash];
+        c.count = 0;
+        c.bytes = 0;
+        c.first_timestamp = timestamp;
+        c.last_timestamp = timestamp;
+        c.fingerprint.assign(&m_buffer[0], size);
+        it = m_classes.find(hash);
+    }
+    Class& c = it->second;
+    ++c.count;
+    c.bytes += sql_statement_size;
+    c.first_timestamp = min(c.first_timestamp, timestamp);
+    c.last_timestamp = max(c.last_timestamp, timestamp);
+}
+
+// Single pass over src; dst must hold 2 * src_size + 4 bytes. Returns the
+// size of the fingerprint written to dst.
+int Fingerprinter::Normalize(const char* src, int src_size, char* dst) {
+    const char* p = src;
+    const char* const end = src + src_size;
+    char* o = dst;
+    bool space = false;
+    int parens[MAX_PAREN_DEPTH];
+    int depth = 0;
+
+    while(p < end) {
+        const char c = *p;
+        const int cc = charClass(c);
+
+        if(CC_SPACE == cc) {
+            space = true;
+            ++p;
+            continue;
+        }
+        if(c == '/' && p + 1 < end && p[1] == '*') {
+            p = skipBlockComment(p, end);
+            space = true;
+            continue;
+        }
+        if(c == '#' || (c == '-' && p + 1 < end && p[1] == '-' && (p + 2 == end || charClass(p[2]) == CC_SPACE))) {
+            p = skipLine(p, end);
+            space = true;
+            continue;
+        }
+
+        if(c == ',' || c == '(' || c == ')') space = false;
+        if(space && o != dst && o[-1] != '(') *o++ = ' ';
+        space = false;
+
+        if(CC_QUOTE == cc) {
+            p = skipStringLiteral(p, end);
+            *o++ = '?';
+        }
+        else if(CC_DIGIT == cc) {
+            for(++p; p < end && (isWordChar(*p) || *p == '.'); ++p) {
+                if((*p == 'e' || *p == 'E') && p + 1 < end && (p[1] == '+' || p[1] == '-')) ++p;
+            }
+            *o++ = '?';
+        }
+        else if(CC_WORD == cc) {
+            for(; p < end && isWordChar(*p); ++p)
+                *o++ = (*p >= 'A' && *p <= 'Z') ? static_cast<char>(*p + ('a' - 'A')) : *p;
+        }
+        else if(c == '`') {
+            const char* close = static_cast<const char*>(memchr(p + 1, '`', end - p - 1));
+            const char* next = close ? close + 1 : end;
+            memcpy(o, p, next - p);
+            o += next - p;
+            p = next;
+        }
+        else if(c == ',') {
+            *o++ = ',';
+            space = true;
+            ++p;
+        }
+        else if(c == '(') {
+            if(depth < MAX_PAREN_DEPTH) parens[depth] = o - dst;
+            ++depth;
+            *o++ = '(';
+            ++p;
+        }
+        else if(c == ')') {
+            if(depth > 0 && --depth < MAX_PAREN_DEPTH &&
+               isPlaceholderList(dst + parens[depth] + 1, o) && isVariableList(dst, dst + parens[depth])) {
+                o = dst + parens[depth] + 1;
+                *o++ = '?';
+                *o++ = '+';
+            }
+            *o++ = ')';
+            ++p;
+            // VALUES (?+), (?+), ... is one row class whatever the row count
+            const int REPEATED_SIZE = 9;
+            if(o - dst >= REPEATED_SIZE && memcmp(o - REPEATED_SIZE, "(?+),(?+)", REPEATED_SIZE) == 0) o -= 5;
+        }
+        else {
+            *o++ = c;
+            ++p;
+        }
+    }
+    return o - dst;
+}
+
+// FNV-1a
+unsigned long long Fingerprinter::Hash(const char* data, int size) {
+    unsigned long long h = 14695981039346656037ULL;
+    for(int i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void Fingerprinter::print(ostream& out, int top) const {
+    vector<pair<unsigned long long, const Class*> > classes;
+    classes.reserve(m_classes.size());
+    for(unordered_map<unsigned long long, Class>::const_iterator it = m_classes.begin(); it != m_classes.end(); ++it)
+        classes.push_back(make_pair(it->first, &it->second));
+
+    struct ByCount {
+        bool operator()(const pair<unsigned long long, const Class*>& a,
+                        const pair<unsigned long long, const Class*>& b) const {
+            if(a.second->count != b.second->count) return a.second->count > b.second->count;
+            if(a.second->bytes != b.second->bytes) return a.second->bytes > b.second->bytes;
+            return a.first < b.first;
+        }
+    };
+    const size_t n = top > 0 && static_cast<size_t>(top) < classes.size() ? top : classes.size();
+    partial_sort(classes.begin(), classes.begin() + n, classes.end(), ByCount());
+
+    out << "fingerprint\tcount\tbytes\tfirst\tlast\tstatement" << '\n';
+    for(size_t i = 0; i < n; ++i) {
+        const Class& c = *classes[i].second;
+        char hash[17];
+        snprintf(hash, sizeof hash, "%016llx", classes[i].first);
+        out << hash << '\t'
+            << c.count << '\t'
+            << c.bytes << '\t'
+            << formatTimestamp(c.first_timestamp) << '\t'
+            << formatTimestamp(c.last_timestamp) << '\t'
+            << c.fingerprint << '\n';
+    }
+    out << flush;
+}
@@ -0,0 +1,44 @@
+#ifndef FINGERPRINT_H_202610191930
+#define FINGERPRINT_H_202610191930
+
+#include "mysqlbinlog.h"
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Groups QUERY_EVENT statements into classes by their fingerprint: the
+// statement with literals replaced by '?', IN and VALUES lists collapsed to
+// '(?+)', comments dropped, whitespace collapsed and keywords lowercased.
+// Statements are normalized in place from the event buffer into a reused
+// scratch buffer; only the first statement of each class is kept.
+class Fingerprinter {
+ public:
+    Fingerprinter();
+
+ public:
+    bool scan(const char* src_file);
+    void add(const char* sql_statement, int sql_statement_size, int timestamp);
+
+ public:
+    void print(std::ostream& out, int top) const;
+
+ public:
+    static int Normalize(const char* src, int src_size, char* dst);
+    static unsigned long long Hash(const char* data, int size);
+
+ private:
+    struct Class {
+        long long count;
+        long long bytes;
+        int first_timestamp;
+        int last_timestamp;
+        std::string fingerprint;
+    };
+
+ private:
+    std::unordered_map<unsigned long long, Class> m_classes;
+    std::vector<char> m_buffer;
+};
+
+#endif // #ifndef FINGERPRINT_H_202610191930
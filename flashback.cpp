@@ -0,0 +1,188 @@
+#include "flashback.h"
+#include "util.h"
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+//******************************
+// FLASHBACK CLASS
+//******************************
+
+Flashback::Flashback(const GtidSet* include_gtids, const GtidSet* exclude_gtids, long long packet_size,
+                     const ColumnNames& column_names):
+    m_include_gtids(include_gtids), m_exclude_gtids(exclude_gtids), m_packet_size(packet_size),
+    m_column_names(column_names), m_num_of_statements(0), m_file_index(-1)
+{
+}
+
+bool Flashback::run(const vector<const char*>& src_files, ostream& out) {
+    BinlogStream stream(src_files);
+    MySQLBinlog parser;
+    if(!stream.open() || !parser.open(&stream)) {
+        cerr << "file open failed " << src_files[0] << endl;
+        return false;
+    }
+
+    m_transactions.clear();
+    m_num_of_statements = 0;
+    m_file_index = -1;
+    bool succeeded = index(stream, parser);
+
+    SQLWriter writer(out, m_packet_size, m_column_names);
+    for(vector<Transaction>::const_reverse_iterator it = m_transactions.rbegin(); succeeded && it != m_transactions.rend(); ++it)
+        succeeded = reverse(*it, stream, parser, writer, out);
+    if(!succeeded) writer.rollback();
+    out << flush;
+
+    if(m_num_of_statements > 0)
+        cerr << m_num_of_statements << " statements logged as SQL (DDL, or binlog_format=STATEMENT) were not reversed" << endl;
+
+    parser.close();
+    stream.close();
+    return succeeded;
+}
+
+// Transactions are delimited the way Sampler::scan does it. Only GTID and
+// QUERY_EVENT bodies are read; transactions cut off by the end of the
+// files were never committed and are left out, and so are those rolled
+// back.
+bool Flashback::index(BinlogStream& stream, MySQLBinlog& parser) {
+    TableMap table_map;
+    MetaMap meta_map;
+    TransactionTracker transactions;
+    bool in_transaction = false;
+    bool selected = false;
+    bool has_rows = false;
+    Transaction transaction;
+
+    while(parser.readEventHeader()) {
+        const TypeCode type = parser.getTypeCode();
+
+        if(PREVIOUS_GTIDS_LOG_EVENT == type) continue;
+
+        if(ROTATE_EVENT == type || STOP_EVENT == type) {
+            transactions.endsTransaction(type, NULL, 0);
+            in_transaction = false;
+            continue;
+        }
+
+        if(!in_transaction || GTID_LOG_EVENT == type || ANONYMOUS_GTID_LOG_EVENT == type) {
+            in_transaction = true;
+            selected = !m_include_gtids;
+            has_rows = false;
+            transaction.begin = stream.getOffset();
+            transaction.timestamp = parser.getTimestamp();
+        }
+
+        bool rolled_back = false;
+
+        if(GTID_LOG_EVENT == type) {
+            if(!parser.readEventData()) return false;
+            const Event* event = parser.getEvent(table_map, meta_map);
+            selected = isSelected(event);
+            delete event;
+        }
+
+        else if(QUERY_EVENT == type) {
+            if(!parser.readEventData()) return false;
+            int sql_statement_size;
+            const char* sql_statement = Event::ReadSQLStatement(parser.getData(), parser.getDataSize(), sql_statement_size);
+            const bool is_begin = sql_statement && sql_statement_size == 5 && memcmp(sql_statement, "BEGIN", 5) == 0;
+            const bool is_commit = sql_statement && sql_statement_size == 6 && memcmp(sql_statement, "COMMIT", 6) == 0;
+            rolled_back = sql_statement && sql_statement_size == 8 && memcmp(sql_statement, "ROLLBACK", 8) == 0;
+            if(selected && !is_begin && !is_commit && !rolled_back) ++m_num_of_statements;
+        }
+
+        else if(WRITE_ROWS_EVENT == type ||
+                UPDATE_ROWS_EVENT == type ||
+                DELETE_ROWS_EVENT == type) {
+            has_rows = true;
+        }
+
+        if(transactions.endsTransaction(type, parser.getData(), parser.getDataSize())) {
+            transaction.end = stream.getNextOffset();
+            if(selected && has_rows && !rolled_back) m_transactions.push_back(transaction);
+            in_transaction = false;
+        }
+    }
+    return true;
+}
+
+bool Flashback::isSelected(const Event* event) const {
+    const string sid = event->getGtidSid();
+    const long long gno = event->getGtidGno();
+    if(m_include_gtids && !m_include_gtids->contains(sid, gno)) return false;
+    if(m_exclude_gtids && m_exclude_gtids->contains(sid, gno)) return false;
+    return true;
+}
+
+// The row events of the transaction are buffered, with the table maps they
+// need, and their rows undone from the last one back.
+bool Flashback::reverse(const Transaction& transaction, BinlogStream& stream, MySQLBinlog& parser,
+                        SQLWriter& writer, ostream& out) {
+    int file_index;
+    int position;
+    if(!stream.toPosition(transaction.begin, file_index, position)) return false;
+    if(file_index != m_file_index) {
+        // the parser learns the file's checksum algorithm from its FORMAT_DESCRIPTION_EVENT
+        if(!stream.seek(stream.toOffset(file_index, 4)) || !parser.readEventHeader()) return false;
+        m_file_index = file_index;
+    }
+    if(!stream.seek(transaction.begin)) return false;
+
+    TableMap table_map;
+    MetaMap meta_map;
+    vector<char> data;
+    vector<pair<TypeCode, pair<size_t, int> > > row_events;
+
+    while(parser.readEventHeader() && stream.getOffset() < transaction.end) {
+        const TypeCode type = parser.getTypeCode();
+        if(TABLE_MAP_EVENT == type) {
+            if(!parser.readEventData()) return false;
+            const Event* event = parser.getEvent(table_map, meta_map);
+            event->storeTableMap(table_map, meta_map);
+            const bool stored = writer.storeTableMap(*event);
+            delete event;
+            if(!stored) return false;
+        }
+        else if(WRITE_ROWS_EVENT == type ||
+                UPDATE_ROWS_EVENT == type ||
+                DELETE_ROWS_EVENT == type) {
+            if(!parser.readEventData()) return false;
+            row_events.push_back(make_pair(type, make_pair(data.size(), parser.getDataSize())));
+            data.insert(data.end(), parser.getData(), parser.getData() + parser.getDataSize());
+        }
+    }
+
+    out << "-- " << stream.getFileName(file_index) << ':' << position << ' '
+        << formatTimestamp(transaction.timestamp) << '\n';
+    writer.begin();
+    vector<SQLRow> rows;
+    for(size_t i = row_events.size(); i-- > 0;) {
+        const TypeCode type = row_events[i].first;
+        RowScanner scanner(&data[row_events[i].second.first], row_events[i].second.second, meta_map, UPDATE_ROWS_EVENT == type);
+        if(!scanner.isValid()) continue;
+
+        rows.clear();
+        while(scanner.next()) {
+            rows.push_back(SQLRow());
+            if(!writer.render(scanner, rows.back())) return false;
+        }
+
+        const TableId table_id = scanner.getTableId();
+        if(UPDATE_ROWS_EVENT == type) {
+            // before and after images alternate; set the row back to its before image
+            for(size_t j = rows.size() / 2; j-- > 0;)
+                if(!writer.update(table_id, rows[2 * j + 1], rows[2 * j])) return false;
+        }
+        else {
+            for(size_t j = rows.size(); j-- > 0;) {
+                const bool written = WRITE_ROWS_EVENT == type ? writer.remove(table_id, rows[j])
+                                                              : writer.insert(table_id, rows[j]);
+                if(!written) return false;
+            }
+        }
+    }
+    writer.commit();
+    return true;
+}
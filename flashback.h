@@ -0,0 +1,51 @@
+#ifndef FLASHBACK_H_202610200130
+#define FLASHBACK_H_202610200130
+
+#include "mysqlbinlog.h"
+#include "binlogstream.h"
+#include "sqlwriter.h"
+#include <ostream>
+#include <vector>
+
+// SQL that undoes the row changes of a binlog, newest transaction first:
+// inserted rows are deleted, deleted rows inserted and updated rows set
+// back to their before image. Events only link forward, so a first pass
+// reads headers alone to index where each transaction begins and ends;
+// the transactions are then read back from the index in reverse, one at a
+// time, so memory is bounded by the largest transaction rather than by
+// the files. The rows of a transaction are undone in reverse too.
+class Flashback {
+ public:
+    Flashback(const GtidSet* include_gtids, const GtidSet* exclude_gtids, long long packet_size,
+              const ColumnNames& column_names);
+
+ public:
+    bool run(const std::vector<const char*>& src_files, std::ostream& out);
+
+ private:
+    // a committed, selected transaction with row events, by BinlogStream offset
+    struct Transaction {
+        long long begin;
+        long long end;
+        int timestamp;
+    };
+
+ private:
+    bool index(BinlogStream& stream, MySQLBinlog& parser);
+    bool reverse(const Transaction& transaction, BinlogStream& stream, MySQLBinlog& parser,
+                 SQLWriter& writer, std::ostream& out);
+    bool isSelected(const Event* event) const;
+
+ private:
+    const GtidSet* m_include_gtids;
+    const GtidSet* m_exclude_gtids;
+    const long long m_packet_size;
+    const ColumnNames m_column_names;
+
+ private:
+    std::vector<Transaction> m_transactions;
+    long long m_num_of_statements;
+    int m_file_index;
+};
+
+#endif // #ifndef FLASHBACK_H_202610200130
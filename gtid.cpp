@@ -0,0 +1,223 @@
+#include "gtid.h"
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+using namespace std;
+
+//******************************
+// GTID SET CLASS
+//******************************
+
+bool GtidSet::parse(const string& text) {
+    clear();
+    stringstream src(text);
+    string item;
+    while(getline(src, item, ',')) {
+        string compact;
+        for(string::iterator it = item.begin(); it != item.end(); ++it)
+            if(!isspace(static_cast<unsigned char>(*it))) compact += *it;
+        if(compact.empty()) continue;
+
+        string::size_type colon = compact.find(':');
+        if(colon == string::npos || colon == 0) return false;
+        const string sid = NormalizeSid(compact.substr(0, colon));
+        char sid_bytes[16];
+        if(!ParseSid(sid, sid_bytes)) return false;
+
+        while(colon != string::npos) {
+            string::size_type next = compact.find(':', colon + 1);
+            const string range = compact.substr(colon + 1, next == string::npos ? string::npos : next - colon - 1);
+            char* endp = NULL;
+            const long long start = strtoll(range.c_str(), &endp, 10);
+            long long last = start;
+            if(*endp == '-') last = strtoll(endp + 1, &endp, 10);
+            if(*endp != '\0' || range.empty() || start < 1 || last < start) return false;
+            addInterval(sid, start, last + 1);
+            colon = next;
+        }
+    }
+    return true;
+}
+
+string GtidSet::toString() const {
+    stringstream ss;
+    for(SidMap::const_iterator it = m_sids.begin(); it != m_sids.end(); ++it) {
+        if(it != m_sids.begin()) ss << ',';
+        ss << it->first;
+        for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit) {
+            ss << ':' << iit->first;
+            if(iit->second - 1 != iit->first) ss << '-' << iit->second - 1;
+        }
+    }
+    ss << flush;
+    return ss.str();
+}
+
+bool GtidSet::encode(string& data) const {
+    data.clear();
+    const int COUNT_BYTE_SIZE = 8;
+    const int SID_BYTE_SIZE = 16;
+    unsigned long long n = m_sids.size();
+    for(int i = 0; i < COUNT_BYTE_SIZE; ++i) data += static_cast<char>((n >> (8 * i)) & 0xFF);
+    for(SidMap::const_iterator it = m_sids.begin(); it != m_sids.end(); ++it) {
+        char sid_bytes[SID_BYTE_SIZE];
+        if(!ParseSid(it->first, sid_bytes)) return false;
+        data.append(sid_bytes, SID_BYTE_SIZE);
+        n = it->second.size();
+        for(int i = 0; i < COUNT_BYTE_SIZE; ++i) data += static_cast<char>((n >> (8 * i)) & 0xFF);
+        for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit) {
+            for(int i = 0; i < COUNT_BYTE_SIZE; ++i) data += static_cast<char>((iit->first >> (8 * i)) & 0xFF);
+            for(int i = 0; i < COUNT_BYTE_SIZE; ++i) data += static_cast<char>((iit->second >> (8 * i)) & 0xFF);
+        }
+    }
+    return true;
+}
+
+void GtidSet::add(const string& sid, long long gno) {
+    addInterval(sid, gno, gno + 1);
+}
+
+void GtidSet::addInterval(const string& sid, long long start, long long end) {
+    if(start >= end) return;
+    Intervals& intervals = m_sids[NormalizeSid(sid)];
+
+    // fast path: transactions of one server arrive in ascending order
+    if(!intervals.empty() && intervals.back().second <= start) {
+        if(intervals.back().second == start) intervals.back().second = end;
+        else intervals.push_back(Interval(start, end));
+        return;
+    }
+
+    Intervals merged;
+    merged.reserve(intervals.size() + 1);
+    bool inserted = false;
+    for(Intervals::iterator it = intervals.begin(); it != intervals.end(); ++it) {
+        if(it->second < start) {
+            merged.push_back(*it);
+        }
+        else if(end < it->first) {
+            if(!inserted) merged.push_back(Interval(start, end));
+            inserted = true;
+            merged.push_back(*it);
+        }
+        else {
+            start = min(start, it->first);
+            end = max(end, it->second);
+        }
+    }
+    if(!inserted) merged.push_back(Interval(start, end));
+    intervals.swap(merged);
+}
+
+void GtidSet::add(const GtidSet& other) {
+    for(SidMap::const_iterator it = other.m_sids.begin(); it != other.m_sids.end(); ++it)
+        for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit)
+            addInterval(it->first, iit->first, iit->second);
+}
+
+void GtidSet::subtract(const GtidSet& other) {
+    for(SidMap::const_iterator oit = other.m_sids.begin(); oit != other.m_sids.end(); ++oit) {
+        SidMap::iterator it = m_sids.find(oit->first);
+        if(it == m_sids.end()) continue;
+
+        Intervals remaining;
+        for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit) {
+            long long start = iit->first;
+            const long long end = iit->second;
+            for(Intervals::const_iterator sit = oit->second.begin(); sit != oit->second.end() && start < end; ++sit) {
+                if(sit->second <= start || end <= sit->first) continue;
+                if(start < sit->first) remaining.push_back(Interval(start, sit->first));
+                start = sit->second;
+            }
+            if(start < end) remaining.push_back(Interval(start, end));
+        }
+
+        if(remaining.empty()) m_sids.erase(it);
+        else it->second.swap(remaining);
+    }
+}
+
+void GtidSet::clear() {
+    m_sids.clear();
+}
+
+bool GtidSet::empty() const {
+    return m_sids.empty();
+}
+
+bool GtidSet::contains(const string& sid, long long gno) const {
+    SidMap::const_iterator it = m_sids.find(sid);
+    if(it == m_sids.end()) return false;
+    for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit) {
+        if(gno < iit->first) return false;
+        if(gno < iit->second) return true;
+    }
+    return false;
+}
+
+bool GtidSet::contains(const GtidSet& other) const {
+    for(SidMap::const_iterator oit = other.m_sids.begin(); oit != other.m_sids.end(); ++oit) {
+        SidMap::const_iterator it = m_sids.find(oit->first);
+        if(it == m_sids.end()) return false;
+        for(Intervals::const_iterator oiit = oit->second.begin(); oiit != oit->second.end(); ++oiit) {
+            bool covered = false;
+            for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit) {
+                if(iit->first <= oiit->first && oiit->second <= iit->second) {
+                    covered = true;
+                    break;
+                }
+            }
+            if(!covered) return false;
+        }
+    }
+    return true;
+}
+
+bool GtidSet::intersects(const GtidSet& other) const {
+    for(SidMap::const_iterator oit = other.m_sids.begin(); oit != other.m_sids.end(); ++oit) {
+        SidMap::const_iterator it = m_sids.find(oit->first);
+        if(it == m_sids.end()) continue;
+        for(Intervals::const_iterator oiit = oit->second.begin(); oiit != oit->second.end(); ++oiit)
+            for(Intervals::const_iterator iit = it->second.begin(); iit != it->second.end(); ++iit)
+                if(iit->first < oiit->second && oiit->first < iit->second) return true;
+    }
+    return false;
+}
+
+string GtidSet::FormatSid(const char* sid_bytes) {
+    static const char HEX[] = "0123456789abcdef";
+    string sid;
+    for(int i = 0; i < 16; ++i) {
+        if(i == 4 || i == 6 || i == 8 || i == 10) sid += '-';
+        const unsigned char byte = static_cast<unsigned char>(sid_bytes[i]);
+        sid += HEX[byte >> 4];
+        sid += HEX[byte & 0x0F];
+    }
+    return sid;
+}
+
+// A SID is 32 hex digits grouped 8-4-4-4-12 by dashes, as FormatSid
+// writes it.
+bool GtidSet::ParseSid(const string& sid, char* sid_bytes) {
+    if(sid.size() != 36) return false;
+    int n = 0;
+    for(string::size_type i = 0; i < sid.size(); ++i) {
+        const bool is_dash_position = i == 8 || i == 13 || i == 18 || i == 23;
+        if(is_dash_position != (sid[i] == '-')) return false;
+        if(is_dash_position) continue;
+        const unsigned char c = static_cast<unsigned char>(sid[i]);
+        if(!isxdigit(c)) return false;
+        const int nibble = isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10);
+        if(n % 2 == 0) sid_bytes[n / 2] = static_cast<char>(nibble << 4);
+        else sid_bytes[n / 2] = static_cast<char>(sid_bytes[n / 2] | nibble);
+        ++n;
+    }
+    return n == 32;
+}
+
+string GtidSet::NormalizeSid(const string& sid) {
+    string normalized(sid);
+    for(string::iterator it = normalized.begin(); it != normalized.end(); ++it)
+        *it = static_cast<char>(tolower(static_cast<unsigned char>(*it)));
+    return normalized;
+}
@@ -0,0 +1,48 @@
+#ifndef GTID_H_202610191030
+#define GTID_H_202610191030
+
+#include <string>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Set of GTIDs, stored as sorted half-open intervals [start, end) per
+// server UUID, the same layout PREVIOUS_GTIDS_LOG_EVENT uses on disk.
+// encode() produces that on-disk layout, as COM_BINLOG_DUMP_GTID expects,
+// and fails on a SID that is not a UUID.
+class GtidSet {
+ public:
+    typedef std::pair<long long, long long> Interval;
+    typedef std::vector<Interval> Intervals;
+    typedef std::map<std::string, Intervals> SidMap;
+
+ public:
+    bool parse(const std::string& text);
+    std::string toString() const;
+    bool encode(std::string& data) const;
+
+ public:
+    void add(const std::string& sid, long long gno);
+    void addInterval(const std::string& sid, long long start, long long end);
+    void add(const GtidSet& other);
+    void subtract(const GtidSet& other);
+    void clear();
+
+ public:
+    bool empty() const;
+    bool contains(const std::string& sid, long long gno) const;
+    bool contains(const GtidSet& other) const;
+    bool intersects(const GtidSet& other) const;
+
+ public:
+    static std::string FormatSid(const char* sid_bytes);
+    static bool ParseSid(const std::string& sid, char* sid_bytes);
+
+ private:
+    static std::string NormalizeSid(const std::string& sid);
+
+ private:
+    SidMap m_sids;
+};
+
+#endif // #ifndef GTID_H_202610191030
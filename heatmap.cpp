@@ -0,0 +1,181 @@
+#include "heatmap.h"
+#include "util.h"
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+namespace {
+
+const size_t INITIAL_CAPACITY = 1024;
+const int EMPTY_CELL = -1;
+
+}
+
+//******************************
+// HEAT MAP CLASS
+//******************************
+
+HeatMap::HeatMap(int bucket_seconds):
+    m_bucket_seconds(bucket_seconds > 0 ? bucket_seconds : 60), m_num_of_cells(0)
+{
+    Cell empty = Cell();
+    empty.table_index = EMPTY_CELL;
+    m_cells.assign(INITIAL_CAPACITY, empty);
+}
+
+bool HeatMap::scan(const char* src_file) {
+    RowEventReader reader;
+    if(!reader.open(src_file)) return false;
+    MySQLBinlog& parser = reader.getParser();
+    RowScanner scanner;
+
+    while(reader.next()) {
+        const TypeCode type = reader.getTypeCode();
+
+        if(TABLE_MAP_EVENT == type) {
+            const Event* event = reader.getTableMaps().getEvent();
+            setTable(event->getTableId(), event->getDBName(), event->getTableName());
+            continue;
+        }
+
+        scanner.reset(parser.getData(), parser.getDataSize(), reader.getTableMaps().getMetaMap(), UPDATE_ROWS_EVENT == type);
+        if(!scanner.isValid()) continue;
+        int num_of_images = 0;
+        int num_of_bytes = 0;
+        while(scanner.next()) {
+            ++num_of_images;
+            num_of_bytes += scanner.getRowSize();
+        }
+        const int num_of_rows = UPDATE_ROWS_EVENT == type ? num_of_images / 2 : num_of_images;
+        add(scanner.getTableId(), parser.getTimestamp(), type, num_of_rows, num_of_bytes);
+    }
+
+    reader.close();
+    return true;
+}
+
+void HeatMap::setTable(TableId table_id, const string& dbname, const string& table_name) {
+    const pss name(dbname, table_name);
+    map<TableId,int>::iterator it = m_table_id_indexes.find(table_id);
+    if(it != m_table_id_indexes.end() && m_tables[it->second] == name) return;
+
+    map<pss,int>::iterator nit = m_table_indexes.find(name);
+    if(nit == m_table_indexes.end()) {
+        nit = m_table_indexes.insert(make_pair(name, static_cast<int>(m_tables.size()))).first;
+        m_tables.push_back(name);
+    }
+    m_table_id_indexes[table_id] = nit->second;
+}
+
+void HeatMap::add(TableId table_id, int timestamp, TypeCode type, int num_of_rows, int num_of_bytes) {
+    map<TableId,int>::const_iterator it = m_table_id_indexes.find(table_id);
+    if(it == m_table_id_indexes.end()) return;
+
+    Operation op;
+    if(WRITE_ROWS_EVENT == type) op = OP_WRITE;
+    else if(UPDATE_ROWS_EVENT == type) op = OP_UPDATE;
+    else if(DELETE_ROWS_EVENT == type) op = OP_DELETE;
+    else return;
+
+    Cell& cell = findCell(it->second, timestamp / m_bucket_seconds);
+    cell.rows[op] += num_of_rows;
+    cell.bytes[op] += num_of_bytes;
+}
+
+size_t HeatMap::Hash(int table_index, long long bucket) {
+    unsigned long long h = static_cast<unsigned long long>(bucket) * 0x9E3779B97F4A7C15ULL;
+    h ^= static_cast<unsigned long long>(table_index) + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+HeatMap::Cell& HeatMap::findCell(int table_index, long long bucket) {
+    if((m_num_of_cells + 1) * 10 > m_cells.size() * 7) grow();
+
+    const size_t mask = m_cells.size() - 1;
+    size_t i = Hash(table_index, bucket) & mask;
+    while(m_cells[i].table_index != EMPTY_CELL) {
+        if(m_cells[i].table_index == table_index && m_cells[i].bucket == bucket) return m_cells[i];
+        i = (i + 1) & mask;
+    }
+
+    Cell& cell = m_cells[i];
+    cell = Cell();
+    cell.table_index = table_index;
+    cell.bucket = bucket;
+    ++m_num_of_cells;
+    return cell;
+}
+
+void HeatMap::grow() {
+    Cell empty = Cell();
+    empty.table_index = EMPTY_CELL;
+    vector<Cell> cells(m_cells.size() * 2, empty);
+    const size_t mask = cells.size() - 1;
+    for(vector<Cell>::const_iterator it = m_cells.begin(); it != m_cells.end(); ++it) {
+        if(it->table_index == EMPTY_CELL) continue;
+        size_t i = Hash(it->table_index, it->bucket) & mask;
+        while(cells[i].table_index != EMPTY_CELL) i = (i + 1) & mask;
+        cells[i] = *it;
+    }
+    m_cells.swap(cells);
+}
+
+vector<const HeatMap::Cell*> HeatMap::sortedCells() const {
+    vector<const Cell*> cells;
+    cells.reserve(m_num_of_cells);
+    for(vector<Cell>::const_iterator it = m_cells.begin(); it != m_cells.end(); ++it)
+        if(it->table_index != EMPTY_CELL) cells.push_back(&*it);
+
+    // m_table_indexes is ordered by name, so the sort compares ranks instead of strings
+    vector<int> ranks(m_tables.size());
+    int rank = 0;
+    for(map<pss,int>::const_iterator it = m_table_indexes.begin(); it != m_table_indexes.end(); ++it)
+        ranks[it->second] = rank++;
+
+    struct ByTableAndBucket {
+        explicit ByTableAndBucket(const vector<int>& ranks): m_ranks(ranks) {}
+        bool operator()(const Cell* a, const Cell* b) const {
+            if(a->table_index != b->table_index) return m_ranks[a->table_index] < m_ranks[b->table_index];
+            return a->bucket < b->bucket;
+        }
+        const vector<int>& m_ranks;
+    };
+    sort(cells.begin(), cells.end(), ByTableAndBucket(ranks));
+    return cells;
+}
+
+void HeatMap::printCSV(ostream& out) const {
+    out << "database,table,time,write_rows,update_rows,delete_rows,write_bytes,update_bytes,delete_bytes" << endl;
+    const vector<const Cell*> cells = sortedCells();
+    for(vector<const Cell*>::const_iterator it = cells.begin(); it != cells.end(); ++it) {
+        const Cell& cell = **it;
+        out << m_tables[cell.table_index].first << ','
+            << m_tables[cell.table_index].second << ','
+            << formatTimestamp(cell.bucket * m_bucket_seconds) << ','
+            << cell.rows[OP_WRITE] << ',' << cell.rows[OP_UPDATE] << ',' << cell.rows[OP_DELETE] << ','
+            << cell.bytes[OP_WRITE] << ',' << cell.bytes[OP_UPDATE] << ',' << cell.bytes[OP_DELETE] << '\n';
+    }
+    out << flush;
+}
+
+void HeatMap::printJSON(ostream& out) const {
+    out << '[' << '\n';
+    const vector<const Cell*> cells = sortedCells();
+    for(vector<const Cell*>::const_iterator it = cells.begin(); it != cells.end(); ++it) {
+        const Cell& cell = **it;
+        out << "{\"database\":\"" << escapeJSON(m_tables[cell.table_index].first)
+            << "\",\"table\":\"" << escapeJSON(m_tables[cell.table_index].second)
+            << "\",\"time\":\"" << formatTimestamp(cell.bucket * m_bucket_seconds)
+            << "\",\"write_rows\":" << cell.rows[OP_WRITE]
+            << ",\"update_rows\":" << cell.rows[OP_UPDATE]
+            << ",\"delete_rows\":" << cell.rows[OP_DELETE]
+            << ",\"write_bytes\":" << cell.bytes[OP_WRITE]
+            << ",\"update_bytes\":" << cell.bytes[OP_UPDATE]
+            << ",\"delete_bytes\":" << cell.bytes[OP_DELETE] << '}'
+            << (it + 1 != cells.end() ? "," : "") << '\n';
+    }
+    out << ']' << endl;
+}
@@ -0,0 +1,59 @@
+#ifndef HEATMAP_H_202610191400
+#define HEATMAP_H_202610191400
+
+#include "mysqlbinlog.h"
+#include <ostream>
+#include <string>
+#include <map>
+#include <vector>
+
+// Rows and bytes changed per (database, table, time bucket) and operation.
+// Row events are only walked for their sizes; no value is ever formatted.
+class HeatMap {
+ public:
+    explicit HeatMap(int bucket_seconds);
+
+ public:
+    bool scan(const char* src_file);
+    void add(TableId table_id, int timestamp, TypeCode type, int num_of_rows, int num_of_bytes);
+
+ public:
+    void printCSV(std::ostream& out) const;
+    void printJSON(std::ostream& out) const;
+
+ private:
+    enum Operation {
+        OP_WRITE, OP_UPDATE, OP_DELETE, NUM_OF_OPERATIONS
+    };
+
+    struct Cell {
+        int table_index;
+        long long bucket;
+        long long rows[NUM_OF_OPERATIONS];
+        long long bytes[NUM_OF_OPERATIONS];
+    };
+
+ private:
+    void setTable(TableId table_id, const std::string& dbname, const std::string& table_name);
+    Cell& findCell(int table_index, long long bucket);
+    void grow();
+    std::vector<const Cell*> sortedCells() const;
+
+ private:
+    static size_t Hash(int table_index, long long bucket);
+
+ private:
+    const int m_bucket_seconds;
+
+ private:
+    std::vector<pss> m_tables;
+    std::map<pss,int> m_table_indexes;
+    std::map<TableId,int> m_table_id_indexes;
+
+ private:
+    // open addressing with linear probing; capacity is a power of two
+    std::vector<Cell> m_cells;
+    size_t m_num_of_cells;
+};
+
+#endif // #ifndef HEATMAP_H_202610191400
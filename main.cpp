@@ -1,12 +1,408 @@
 #include "mysqlbinlog.h"
+#include "heatmap.h"
+#include "fingerprint.h"
+#include "search.h"
+#include "sampler.h"
+#include "checksum.h"
+#include "flashback.h"
+#include "sqlwriter.h"
+#include "checkpoint.h"
+#include "compactor.h"
+#include "shardwriter.h"
+#include "dumpclient.h"
+#include "fanout.h"
+#include "util.h"
 #include <Poco/DateTime.h>
+#include <Poco/Path.h>
 #include <Poco/Timestamp.h>
 #include <iostream>
+#include <sstream>
 #include <cstdlib>
+#include <cstring>
 using namespace std;
 
+struct Options {
+    Options(): gtid_summary(false), has_include_gtids(false), has_exclude_gtids(false),
+               bucket_seconds(60), memory_budget(256LL << 20),
+               partition_by(ShardWriter::PARTITION_BY_TABLE), hash_column(0),
+               num_of_partitions(16), num_of_writers(4), max_open_files(64),
+               port(3306), server_id(-1), start_position(4), stop_never(false),
+               fingerprint(false), top(20), num_of_threads(4), sample_rate(0), checksum(false), flashback(false),
+               sql_format(false), packet_size(SQLWriter::DEFAULT_PACKET_SIZE),
+               ring_size(64LL << 20), max_consumers(16), drop_slow_consumers(false) {}
+    vector<const char*> src_files;
+    bool gtid_summary;
+    bool has_include_gtids;
+    GtidSet include_gtids;
+    bool has_exclude_gtids;
+    GtidSet exclude_gtids;
+    string heatmap_format;
+    int bucket_seconds;
+    KeyColumns compact_key_columns;
+    long long memory_budget;
+    string output_dir;
+    ShardWriter::PartitionBy partition_by;
+    int hash_column;
+    int num_of_partitions;
+    int num_of_writers;
+    int max_open_files;
+    string host;
+    int port;
+    string socket_path;
+    string user;
+    string password;
+    int server_id;
+    int start_position;
+    bool stop_never;
+    bool fingerprint;
+    int top;
+    Predicates predicates;
+    int num_of_threads;
+    double sample_rate;
+    bool checksum;
+    bool flashback;
+    bool sql_format;
+    long long packet_size;
+    ColumnNames column_names;
+    string checkpoint_path;
+    string publish_name;
+    long long ring_size;
+    int max_consumers;
+    bool drop_slow_consumers;
+};
+
 void usage() {
-    cerr << "usage: mysqlbinlog2 mysql-bin.000001" << endl;
+    cerr << "usage: mysqlbinlog2 [options] mysql-bin.000001 [mysql-bin.000002 ...]" << endl
+         << "       mysqlbinlog2 --host=HOST[:PORT]|--socket=PATH [options] mysql-bin.000001" << endl
+         << "  --include-gtids=SET   print only transactions whose GTID is in SET" << endl
+         << "  --exclude-gtids=SET   skip transactions whose GTID is in SET" << endl
+         << "  --gtid-summary        print the GTID range of each file and exit" << endl
+         << "  --heatmap[=csv|json]  print rows and bytes changed per table and time bucket" << endl
+         << "  --bucket=SECONDS      time bucket width of --heatmap and --checksum (default 60)" << endl
+         << "  --compact=DB.TABLE:COLS" << endl
+         << "                        print the net change per key of DB.TABLE, keyed by the" << endl
+         << "                        comma separated column indexes COLS (repeatable)" << endl
+         << "  --memory-budget=SIZE  memory for --compact before spilling to disk (default 256M)" << endl
+         << "  --output-dir=DIR      write rows into one file per partition under DIR" << endl
+         << "  --partition-by=table|hash(COL)" << endl
+         << "                        partition --output-dir per table (default) or by the" << endl
+         << "                        hash of column index COL" << endl
+         << "  --partitions=N        number of hash partitions (default 16)" << endl
+         << "  --writers=N           number of writer threads (default 4, at most --max-open-files)" << endl
+         << "  --max-open-files=N    open output files kept by the writers (default 64)" << endl
+         << "  --host=HOST[:PORT]    read the binlog from a server over TCP (default port 3306)" << endl
+         << "  --socket=PATH         read the binlog from a server over a unix socket" << endl
+         << "  --user=NAME           user name for --host/--socket" << endl
+         << "  --password=PASSWORD   password for --host/--socket" << endl
+         << "  --start-position=POS  position to start reading the remote binlog (default 4)" << endl
+         << "  --server-id=ID        server id to register as (default 0, or 1 with --stop-never)" << endl
+         << "  --stop-never          keep waiting for new events instead of stopping at the end" << endl
+         << "  --fingerprint         print the statement classes of QUERY_EVENTs by frequency" << endl
+         << "  --top=N               number of classes printed by --fingerprint (default 20, 0 for all)" << endl
+         << "  --search=DB.TABLE:COL=VALUE" << endl
+         << "                        print the rows of DB.TABLE whose column index COL equals" << endl
+         << "                        VALUE (or null), with file and position (repeatable, ANDed" << endl
+         << "                        per table); integer and string columns are searchable" << endl
+         << "  --threads=N           files read in parallel by --search and --checksum (default 4)" << endl
+         << "  --sample=RATE         estimate rows and bytes changed per table from a RATE (0-1]" << endl
+         << "                        fraction of the transactions, with 95% error bounds" << endl
+         << "  --checksum            print order-independent checksums of the row changes per" << endl
+         << "                        table and time bucket, to compare a replica with its primary" << endl
+         << "  --flashback           print SQL that undoes the row changes, newest transaction" << endl
+         << "                        first (select transactions with --include/--exclude-gtids)" << endl
+         << "  --format=text|sql     print events as text (default) or as SQL to replay them" << endl
+         << "  --packet-size=SIZE    largest statement of --format=sql and --flashback; rows are" << endl
+         << "                        merged into multi-row statements up to it (default 1M)" << endl
+         << "  --columns=DB.TABLE:COLS" << endl
+         << "                        name the columns of DB.TABLE, comma separated in table order," << endl
+         << "                        for SQL output of binlogs without them (repeatable)" << endl
+         << "  --checkpoint=FILE     resume from the position saved in FILE and save the position" << endl
+         << "                        after each complete transaction; a killed run repeats at" << endl
+         << "                        most one transaction, a system crash up to 64K of output" << endl
+         << "  --publish=NAME        publish the decoded events into the shared-memory ring NAME" << endl
+         << "                        for local consumers (see fanoutcat) instead of printing them" << endl
+         << "  --ring-size=SIZE      size of the --publish ring, a power of two (default 64M)" << endl
+         << "  --max-consumers=N     consumers that can attach to the ring at once (default 16)" << endl
+         << "  --slow-consumer=wait|drop" << endl
+         << "                        wait for a consumer a full ring behind (default) or drop it" << endl
+         << "--gtid-summary, --heatmap, --compact, --output-dir, --fingerprint, --search, --sample," << endl
+         << "--checksum and --flashback are exclusive, read local files from the start and take" << endl
+         << "no --checkpoint, --publish, --host/--socket or --format=sql; of them only --flashback" << endl
+         << "takes --include-gtids/--exclude-gtids" << endl;
+}
+
+bool matchOption(const char* arg, const char* name, string& value) {
+    const size_t name_size = strlen(name);
+    if(strncmp(arg, name, name_size) != 0) return false;
+    if(arg[name_size] == '\0') {
+        value.clear();
+        return true;
+    }
+    if(arg[name_size] != '=') return false;
+    value = arg + name_size + 1;
+    return true;
+}
+
+bool parseOptions(int argc, const char* argv[], Options& opt) {
+    for(int i = 1; i < argc; ++i) {
+        string value;
+        if(matchOption(argv[i], "--include-gtids", value)) {
+            if(!opt.include_gtids.parse(value)) {
+                cerr << "invalid GTID set " << value << endl;
+                return false;
+            }
+            opt.has_include_gtids = true;
+        }
+        else if(matchOption(argv[i], "--exclude-gtids", value)) {
+            if(!opt.exclude_gtids.parse(value)) {
+                cerr << "invalid GTID set " << value << endl;
+                return false;
+            }
+            opt.has_exclude_gtids = true;
+        }
+        else if(matchOption(argv[i], "--gtid-summary", value)) {
+            opt.gtid_summary = true;
+        }
+        else if(matchOption(argv[i], "--heatmap", value)) {
+            opt.heatmap_format = value.empty() ? "csv" : value;
+            if(opt.heatmap_format != "csv" && opt.heatmap_format != "json") {
+                cerr << "unknown heatmap format " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--bucket", value)) {
+            opt.bucket_seconds = atoi(value.c_str());
+            if(opt.bucket_seconds <= 0) {
+                cerr << "invalid bucket width " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--compact", value)) {
+            if(!Compactor::ParseKeyColumns(value, opt.compact_key_columns)) {
+                cerr << "invalid key columns " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--memory-budget", value)) {
+            if(!parseByteSize(value, opt.memory_budget)) {
+                cerr << "invalid memory budget " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--output-dir", value)) {
+            opt.output_dir = value;
+        }
+        else if(matchOption(argv[i], "--partition-by", value)) {
+            if(!ShardWriter::ParsePartitionBy(value, opt.partition_by, opt.hash_column)) {
+                cerr << "invalid partitioning " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--partitions", value)) {
+            opt.num_of_partitions = atoi(value.c_str());
+            if(opt.num_of_partitions <= 0) {
+                cerr << "invalid number of partitions " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--writers", value)) {
+            opt.num_of_writers = atoi(value.c_str());
+            if(opt.num_of_writers <= 0) {
+                cerr << "invalid number of writers " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--max-open-files", value)) {
+            opt.max_open_files = atoi(value.c_str());
+            if(opt.max_open_files <= 0) {
+                cerr << "invalid number of open files " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--host", value)) {
+            const string::size_type colon = value.rfind(':');
+            opt.host = value.substr(0, colon);
+            if(colon != string::npos) {
+                opt.port = atoi(value.c_str() + colon + 1);
+                if(opt.port <= 0 || opt.port > 65535) {
+                    cerr << "invalid port " << value << endl;
+                    return false;
+                }
+            }
+        }
+        else if(matchOption(argv[i], "--socket", value)) {
+            opt.socket_path = value;
+        }
+        else if(matchOption(argv[i], "--user", value)) {
+            opt.user = value;
+        }
+        else if(matchOption(argv[i], "--password", value)) {
+            opt.password = value;
+        }
+        else if(matchOption(argv[i], "--start-position", value)) {
+            opt.start_position = atoi(value.c_str());
+            if(opt.start_position < 4) {
+                cerr << "invalid start position " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--server-id", value)) {
+            opt.server_id = atoi(value.c_str());
+            if(opt.server_id < 0) {
+                cerr << "invalid server id " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--stop-never", value)) {
+            opt.stop_never = true;
+        }
+        else if(matchOption(argv[i], "--fingerprint", value)) {
+            opt.fingerprint = true;
+        }
+        else if(matchOption(argv[i], "--top", value)) {
+            opt.top = atoi(value.c_str());
+            if(opt.top < 0 || value.empty()) {
+                cerr << "invalid number of classes " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--search", value)) {
+            Predicate predicate;
+            if(!Searcher::ParsePredicate(value, predicate)) {
+                cerr << "invalid predicate " << value << endl;
+                return false;
+            }
+            opt.predicates.push_back(predicate);
+        }
+        else if(matchOption(argv[i], "--threads", value)) {
+            opt.num_of_threads = atoi(value.c_str());
+            if(opt.num_of_threads <= 0) {
+                cerr << "invalid number of threads " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--sample", value)) {
+            char* endp = NULL;
+            opt.sample_rate = strtod(value.c_str(), &endp);
+            if(value.empty() || *endp != '\0' || !(opt.sample_rate > 0 && opt.sample_rate <= 1)) {
+                cerr << "invalid sample rate " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--checksum", value)) {
+            opt.checksum = true;
+        }
+        else if(matchOption(argv[i], "--flashback", value)) {
+            opt.flashback = true;
+        }
+        else if(matchOption(argv[i], "--format", value)) {
+            if(value != "text" && value != "sql") {
+                cerr << "unknown format " << value << endl;
+                return false;
+            }
+            opt.sql_format = value == "sql";
+        }
+        else if(matchOption(argv[i], "--packet-size", value)) {
+            if(!parseByteSize(value, opt.packet_size) || opt.packet_size <= 0) {
+                cerr << "invalid packet size " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--columns", value)) {
+            if(!SQLWriter::ParseColumnNames(value, opt.column_names)) {
+                cerr << "invalid column names " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--checkpoint", value)) {
+            if(value.empty()) {
+                cerr << "--checkpoint needs a file name" << endl;
+                return false;
+            }
+            opt.checkpoint_path = value;
+        }
+        else if(matchOption(argv[i], "--publish", value)) {
+            if(value.empty()) {
+                cerr << "--publish needs a ring name" << endl;
+                return false;
+            }
+            opt.publish_name = value;
+        }
+        else if(matchOption(argv[i], "--ring-size", value)) {
+            if(!parseByteSize(value, opt.ring_size)) {
+                cerr << "invalid ring size " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--max-consumers", value)) {
+            opt.max_consumers = atoi(value.c_str());
+            if(opt.max_consumers <= 0) {
+                cerr << "invalid number of consumers " << value << endl;
+                return false;
+            }
+        }
+        else if(matchOption(argv[i], "--slow-consumer", value)) {
+            if(value != "wait" && value != "drop") {
+                cerr << "unknown slow consumer policy " << value << endl;
+                return false;
+            }
+            opt.drop_slow_consumers = value == "drop";
+        }
+        else if(strncmp(argv[i], "--", 2) == 0) {
+            cerr << "unknown option " << argv[i] << endl;
+            return false;
+        }
+        else {
+            opt.src_files.push_back(argv[i]);
+        }
+    }
+    if(!opt.host.empty() && !opt.socket_path.empty()) {
+        cerr << "--host and --socket are exclusive" << endl;
+        return false;
+    }
+    if((!opt.host.empty() || !opt.socket_path.empty()) && opt.src_files.size() > 1) {
+        cerr << "only one remote binlog can be named; later files follow by rotation" << endl;
+        return false;
+    }
+    if(!opt.publish_name.empty() && !opt.checkpoint_path.empty()) {
+        cerr << "--publish and --checkpoint are exclusive" << endl;
+        return false;
+    }
+    if(!opt.publish_name.empty() && opt.sql_format) {
+        cerr << "--publish applies to text output only" << endl;
+        return false;
+    }
+    // the modes below replace the printed events, and read local files
+    // from the start; only --flashback filters by GTID
+    const int num_of_modes = opt.gtid_summary + !opt.heatmap_format.empty() + !opt.predicates.empty() + opt.fingerprint +
+                             (opt.sample_rate > 0) + opt.checksum + opt.flashback +
+                             !opt.compact_key_columns.empty() + !opt.output_dir.empty();
+    if(num_of_modes > 1) {
+        cerr << "--gtid-summary, --heatmap, --search, --fingerprint, --sample, --checksum, --flashback, "
+             << "--compact and --output-dir are exclusive" << endl;
+        return false;
+    }
+    if(num_of_modes > 0 && !opt.publish_name.empty()) {
+        cerr << "--publish applies to printed events only" << endl;
+        return false;
+    }
+    if(num_of_modes > 0 && !opt.checkpoint_path.empty()) {
+        cerr << "--checkpoint applies to printed events only" << endl;
+        return false;
+    }
+    if(num_of_modes > 0 && (!opt.host.empty() || !opt.socket_path.empty())) {
+        cerr << "--host and --socket apply to printed events only" << endl;
+        return false;
+    }
+    if(num_of_modes > 0 && opt.sql_format) {
+        cerr << "--format=sql applies to printed events only" << endl;
+        return false;
+    }
+    if(num_of_modes > 0 && !opt.flashback && (opt.has_include_gtids || opt.has_exclude_gtids)) {
+        cerr << "--include-gtids and --exclude-gtids apply to printed events and --flashback only" << endl;
+        return false;
+    }
+    return !opt.src_files.empty();
 }
 
 void printBinlogInfo(const MySQLBinlog& parser) {
@@ -18,7 +414,9 @@ void printBinlogInfo(const MySQLBinlog& parser) {
 void printTimestamp(int time) {
     Poco::Timestamp epoch = Poco::Timestamp::fromEpochTime(time);
     Poco::DateTime dt(epoch);
-    printf("%d/%02d/%02d %02d:%02d:%02d UTC", dt.year(), dt.month(), dt.day(), dt.hour(), dt.minute(), dt.second());
+    char buf[32];
+    snprintf(buf, sizeof buf, "%d/%02d/%02d %02d:%02d:%02d UTC", dt.year(), dt.month(), dt.day(), dt.hour(), dt.minute(), dt.second());
+    cout << buf;
 }
 
 void printQueryEvent(const Event* event) {
@@ -42,8 +440,22 @@ void printXidEvent(const Event* event) {
     cout << '\t' << "XID_EVENT" << endl;
 }
 
+void printGtidEvent(const Event* event) {
+    cout << '\t' << "GTID_LOG_EVENT" << '\t'
+         << event->getGtidSid() << ':' << event->getGtidGno() << endl;
+}
+
+void printAnonymousGtidEvent(const Event* event) {
+    cout << '\t' << "ANONYMOUS_GTID_LOG_EVENT" << endl;
+}
+
+void printPreviousGtidsEvent(const Event* event) {
+    cout << '\t' << "PREVIOUS_GTIDS_LOG_EVENT" << '\t'
+         << event->getPreviousGtids().toString() << endl;
+}
+
 void storePrintTableMapEvent(const Event* event, TableMap& table_map, MetaMap& meta_map) {
-    const int table_id = event->getTableId();
+    const TableId table_id = event->getTableId();
     const int num_of_columns = event->getNumOfColumns();
     const string dbname = event->getDBName();
     const string table_name = event->getTableName();
@@ -52,21 +464,14 @@ void storePrintTableMapEvent(const Event* event, TableMap& table_map, MetaMap& m
          << table_name << '\t'
          << "col:" << num_of_columns << '\t'
          << "id:" << table_id << endl;
-    table_map[table_id] = pss(dbname, table_name);
-
-    vector<ColumnType> vc(num_of_columns);
-    vector<int> vi(num_of_columns);
-    for(int i = 0; i < num_of_columns; ++i) {
-        vc[i] = event->getColumnType(i);
-        vi[i] = event->getMetadata(i);
-    }
-    meta_map[table_id] = pvv(vc,vi);
+    event->storeTableMap(table_map, meta_map);
 }
 
 void printWriteRowsEvent(const Event* event, const TableMap& table_map) {
-    const int table_id = event->getTableId();
-    const string database_name = table_map.at(table_id).first;
-    const string table_name = table_map.at(table_id).second;
+    TableMap::const_iterator tit = table_map.find(event->getTableId());
+    if(tit == table_map.end()) return;
+    const string database_name = tit->second.first;
+    const string table_name = tit->second.second;
 
     vector<RowImg> rows = event->getRows();
 
@@ -88,9 +493,10 @@ void printWriteRowsEvent(const Event* event, const TableMap& table_map) {
 }
 
 void printDeleteRowsEvent(const Event* event, const TableMap& table_map) {
-    const int table_id = event->getTableId();
-    const string database_name = table_map.at(table_id).first;
-    const string table_name = table_map.at(table_id).second;
+    TableMap::const_iterator tit = table_map.find(event->getTableId());
+    if(tit == table_map.end()) return;
+    const string database_name = tit->second.first;
+    const string table_name = tit->second.second;
 
     vector<RowImg> rows = event->getRows();
 
@@ -112,9 +518,10 @@ void printDeleteRowsEvent(const Event* event, const TableMap& table_map) {
 }
 
 void printUpdateRowsEvent(const Event* event, const TableMap& table_map) {
-    const int table_id = event->getTableId();
-    const string database_name = table_map.at(table_id).first;
-    const string table_name = table_map.at(table_id).second;
+    TableMap::const_iterator tit = table_map.find(event->getTableId());
+    if(tit == table_map.end()) return;
+    const string database_name = tit->second.first;
+    const string table_name = tit->second.second;
 
     vector<RowImg> rows = event->getRows();
 
@@ -141,34 +548,235 @@ void printUpdateRowsEvent(const Event* event, const TableMap& table_map) {
     }
 }
 
-int main(int argc, const char* argv[]) {
+// MySQL writes PREVIOUS_GTIDS_LOG_EVENT right after FORMAT_DESCRIPTION_EVENT,
+// so the GTIDs executed before a file are known after reading two events.
+bool readPreviousGtids(const char* src_file, GtidSet& previous_gtids) {
+    MySQLBinlog parser;
+    previous_gtids.clear();
+    if(!parser.open(src_file)) return false;
 
-    if (argc != 2) {
-        usage();
-        return EXIT_FAILURE;
+    bool found = false;
+    if(parser.readEventHeader() && PREVIOUS_GTIDS_LOG_EVENT == parser.getTypeCode() && parser.readEventData()) {
+        const Event* event = parser.getEvent(TableMap(), MetaMap());
+        previous_gtids = event->getPreviousGtids();
+        found = true;
+        delete event;
     }
+    parser.close();
+    return found;
+}
 
-    const char* SRC_FILE = argv[1];
-
+// Decodes only the GTID events of a file; every other event is stepped over
+// by its header.
+bool collectGtids(const char* src_file, GtidSet& gtids, int& num_of_transactions) {
     MySQLBinlog parser;
+    gtids.clear();
+    num_of_transactions = 0;
+    if(!parser.open(src_file)) return false;
 
-    if(!parser.open(SRC_FILE)) {
-        cerr << "file open failed " << SRC_FILE << endl;
-        return EXIT_FAILURE;
+    TableMap table_map;
+    MetaMap meta_map;
+    while(parser.readEventHeader()) {
+        if(GTID_LOG_EVENT != parser.getTypeCode()) continue;
+        if(!parser.readEventData()) break;
+        const Event* event = parser.getEvent(table_map, meta_map);
+        gtids.add(event->getGtidSid(), event->getGtidGno());
+        ++num_of_transactions;
+        delete event;
     }
+    parser.close();
+    return true;
+}
 
-    printBinlogInfo(parser);
+bool printGtidSummary(const Options& opt) {
+    cout << "file\ttransactions\tprevious_gtids\tgtids" << endl;
+    for(vector<const char*>::const_iterator it = opt.src_files.begin(); it != opt.src_files.end(); ++it) {
+        GtidSet previous_gtids;
+        GtidSet gtids;
+        int num_of_transactions;
+        readPreviousGtids(*it, previous_gtids);
+        if(!collectGtids(*it, gtids, num_of_transactions)) {
+            cerr << "file open failed " << *it << endl;
+            return false;
+        }
+        cout << *it << '\t'
+             << num_of_transactions << '\t'
+             << previous_gtids.toString() << '\t'
+             << gtids.toString() << endl;
+    }
+    return true;
+}
+
+// A file holds at most the GTIDs that are in the next file's PREVIOUS_GTIDS
+// but not in its own. Without a next file only the lower bound is known.
+bool canSkipFile(const Options& opt, const GtidSet& previous_gtids, const GtidSet* next_previous_gtids) {
+    if(next_previous_gtids) {
+        GtidSet range(*next_previous_gtids);
+        range.subtract(previous_gtids);
+        if(opt.has_include_gtids && !range.intersects(opt.include_gtids)) return true;
+        if(opt.has_exclude_gtids && !range.empty() && opt.exclude_gtids.contains(range)) return true;
+        return false;
+    }
+    return opt.has_include_gtids && previous_gtids.contains(opt.include_gtids);
+}
+
+bool isSelectedGtid(const Options& opt, const Event* event) {
+    const string sid = event->getGtidSid();
+    const long long gno = event->getGtidGno();
+    if(opt.has_include_gtids && !opt.include_gtids.contains(sid, gno)) return false;
+    if(opt.has_exclude_gtids && opt.exclude_gtids.contains(sid, gno)) return false;
+    return true;
+}
+
+// --format=sql: row events become INSERT, UPDATE and DELETE statements
+// within their transactions, and other statements are written as logged.
+bool writeSQLEvent(const MySQLBinlog& parser, const Event* event, TableMap& table_map, MetaMap& meta_map, SQLWriter& sql) {
+    const TypeCode type = event->getTypeCode();
+
+    if (QUERY_EVENT == type) {
+        const string sql_statement = event->getSQLStatement();
+        if (sql_statement == "BEGIN") sql.begin();
+        else if (sql_statement == "COMMIT") sql.commit();
+        else sql.statement(event->getDBName(), sql_statement, parser.getFlags() & LOG_EVENT_SUPPRESS_USE_F);
+    }
+
+    else if (XID_EVENT == type) {
+        sql.commit();
+    }
+
+    else if (TABLE_MAP_EVENT == type) {
+        event->storeTableMap(table_map, meta_map);
+        if (!sql.storeTableMap(*event)) return false;
+    }
+
+    else if (WRITE_ROWS_EVENT == type || UPDATE_ROWS_EVENT == type || DELETE_ROWS_EVENT == type) {
+        RowScanner scanner(parser.getData(), parser.getDataSize(), meta_map, UPDATE_ROWS_EVENT == type);
+        SQLRow before;
+        SQLRow row;
+        while (scanner.next()) {
+            if (UPDATE_ROWS_EVENT == type && !scanner.isAfterImage()) {
+                if (!sql.render(scanner, before)) return false;
+                continue;
+            }
+            if (!sql.render(scanner, row)) return false;
+            bool written;
+            if (WRITE_ROWS_EVENT == type) written = sql.insert(scanner.getTableId(), row);
+            else if (DELETE_ROWS_EVENT == type) written = sql.remove(scanner.getTableId(), row);
+            else written = sql.update(scanner.getTableId(), before, row);
+            if (!written) return false;
+        }
+    }
+
+    return true;
+}
+
+bool isRowsEvent(TypeCode type) {
+    return WRITE_ROWS_EVENT == type || UPDATE_ROWS_EVENT == type || DELETE_ROWS_EVENT == type;
+}
+
+// Whether the events read so far show the run started inside a transaction,
+// as a --start-position or a remote dump can: its first TABLE_MAP_EVENT,
+// rows event, XID_EVENT or COMMIT comes before any event opening one.
+// Returns false until that is known; started is set once it is.
+bool startsInsideTransaction(TypeCode type, const char* data, int data_size, bool& started) {
+    if (started) return false;
+    if (GTID_LOG_EVENT == type || ANONYMOUS_GTID_LOG_EVENT == type) {
+        started = true;
+        return false;
+    }
+    if (QUERY_EVENT == type) {
+        int sql_statement_size;
+        const char* sql_statement = Event::ReadSQLStatement(data, data_size, sql_statement_size);
+        started = true;
+        return sql_statement &&
+            ((sql_statement_size == 6 && memcmp(sql_statement, "COMMIT", 6) == 0) ||
+             (sql_statement_size == 8 && memcmp(sql_statement, "ROLLBACK", 8) == 0));
+    }
+    if (TABLE_MAP_EVENT == type || XID_EVENT == type || isRowsEvent(type)) {
+        started = true;
+        return true;
+    }
+    return false;
+}
+
+bool printEvents(MySQLBinlog& parser, const Options& opt, Checkpoint* checkpoint, FanoutOutput* fanout, SQLWriter* sql) {
 
     TableMap table_map;
     MetaMap meta_map;
 
-    while(parser.read()) {
+    if (checkpoint) {
+        table_map = checkpoint->table_map;
+        meta_map = checkpoint->meta_map;
+    }
+
+    cout << flush;
+    CheckpointedOutput* output = checkpoint ? new CheckpointedOutput(cout, *checkpoint, opt.checkpoint_path) : NULL;
+    bool succeeded = true;
+
+    bool selected = !opt.has_include_gtids;
+    TransactionTracker transactions;
+    bool started = false;
+
+    // the server version line printed from the FORMAT_DESCRIPTION_EVENT
+    if (fanout && !fanout->empty()) {
+        succeeded = fanout->publish(FORMAT_DESCRIPTION_EVENT, 0);
+    }
+
+    while(succeeded && parser.readEventHeader()) {
+        const TypeCode header_type = parser.getTypeCode();
+
+        // events of an unselected transaction are skipped by header only
+        if (!selected &&
+            GTID_LOG_EVENT != header_type &&
+            ANONYMOUS_GTID_LOG_EVENT != header_type &&
+            PREVIOUS_GTIDS_LOG_EVENT != header_type &&
+            ROTATE_EVENT != header_type &&
+            STOP_EVENT != header_type) {
+            if (output && XID_EVENT == header_type)
+                succeeded = output->commit(parser.getNextPosition(), table_map, meta_map);
+            continue;
+        }
+
+        if (!parser.readEventData()) break;
+
+        if (startsInsideTransaction(header_type, parser.getData(), parser.getDataSize(), started)) {
+            cerr << "reading starts inside a transaction at position "
+                 << parser.getPosition()
+                 << "; give a position where a transaction begins to read it whole" << endl;
+        }
+
+        // rows whose TABLE_MAP_EVENT was not read cannot be decoded
+        if (isRowsEvent(header_type) &&
+            (parser.getDataSize() < 6 || !table_map.count(Event::ReadTableId(parser.getData())))) {
+            cerr << "skipped a rows event at position "
+                 << parser.getPosition()
+                 << ": the TABLE_MAP_EVENT of its table was not read" << endl;
+            continue;
+        }
+
         const Event* event = parser.getEvent(table_map, meta_map);
         const TypeCode type = event->getTypeCode();
 
-        printTimestamp(event->getTimestamp());
+        if (GTID_LOG_EVENT == type) {
+            selected = isSelectedGtid(opt, event);
+        }
+        else if (ANONYMOUS_GTID_LOG_EVENT == type) {
+            selected = !opt.has_include_gtids;
+        }
 
-        if (QUERY_EVENT == type) {
+        if (!selected &&
+            (GTID_LOG_EVENT == type || ANONYMOUS_GTID_LOG_EVENT == type)) {
+            delete event;
+            continue;
+        }
+
+        if (!sql) printTimestamp(event->getTimestamp());
+
+        if (sql) {
+            succeeded = writeSQLEvent(parser, event, table_map, meta_map, *sql);
+        }
+
+        else if (QUERY_EVENT == type) {
             printQueryEvent(event);
         }
 
@@ -184,6 +792,18 @@ int main(int argc, const char* argv[]) {
             printXidEvent(event);
         }
 
+        else if (GTID_LOG_EVENT == type) {
+            printGtidEvent(event);
+        }
+
+        else if (ANONYMOUS_GTID_LOG_EVENT == type) {
+            printAnonymousGtidEvent(event);
+        }
+
+        else if (PREVIOUS_GTIDS_LOG_EVENT == type) {
+            printPreviousGtidsEvent(event);
+        }
+
         else if (TABLE_MAP_EVENT == type) {
             storePrintTableMapEvent(event, table_map, meta_map);
         }
@@ -200,10 +820,234 @@ int main(int argc, const char* argv[]) {
             printDeleteRowsEvent(event, table_map);
         }
 
+        if (fanout) {
+            succeeded = fanout->publish(type, event->getTimestamp());
+        }
+
+        const bool ends_transaction = transactions.endsTransaction(type, parser.getData(), parser.getDataSize());
+        if (output && ROTATE_EVENT == type) {
+            checkpoint->binlog_name = event->getNextBinlogName();
+            table_map.clear();
+            meta_map.clear();
+            succeeded = output->commit(4, table_map, meta_map);
+        }
+        else if (output && ends_transaction) {
+            succeeded = output->commit(parser.getNextPosition(), table_map, meta_map);
+        }
+
         delete event;
     }
 
+    if (sql && succeeded) {
+        sql->flush();
+    }
+    else if (sql) {
+        sql->rollback();
+    }
+
+    if (output) {
+        succeeded = output->flush() && succeeded;
+        delete output;
+    }
+
+    return succeeded;
+}
+
+bool printBinlog(const char* src_file, const Options& opt, Checkpoint* checkpoint, FanoutOutput* fanout, SQLWriter* sql) {
+
+    MySQLBinlog parser;
+
+    if(!parser.open(src_file)) {
+        cerr << "file open failed " << src_file << endl;
+        return false;
+    }
+
+    const string binlog_name = Poco::Path(src_file).getFileName();
+    if (checkpoint && checkpoint->binlog_name == binlog_name && checkpoint->position > 4) {
+        parser.setNextPosition(checkpoint->position);
+    }
+    else {
+        if (checkpoint) {
+            checkpoint->binlog_name = binlog_name;
+            checkpoint->position = 4;
+            checkpoint->table_map.clear();
+            checkpoint->meta_map.clear();
+        }
+        if (!sql) printBinlogInfo(parser);
+    }
+
+    const bool succeeded = printEvents(parser, opt, checkpoint, fanout, sql);
+
     parser.close();
 
-    return EXIT_SUCCESS;
+    return succeeded;
+}
+
+// Streams the binlog straight from the server, as a replica would. With
+// --exclude-gtids the server is asked to skip those transactions itself,
+// unless a checkpoint names the file and position to continue from.
+bool printRemoteBinlog(const char* binlog_name, const Options& opt, Checkpoint* checkpoint, FanoutOutput* fanout, SQLWriter* sql) {
+
+    DumpClient client;
+
+    const bool connected = opt.socket_path.empty() ?
+        client.connect(opt.host, opt.port) : client.connect(opt.socket_path);
+    if(!connected || !client.login(opt.user, opt.password)) return false;
+
+    // servers only keep a dump open waiting for new events for a non-zero id
+    const int server_id = opt.server_id >= 0 ? opt.server_id : (opt.stop_never ? 1 : 0);
+    if (checkpoint && checkpoint->empty()) {
+        checkpoint->binlog_name = binlog_name;
+        checkpoint->position = opt.start_position;
+    }
+    const bool dumping = opt.has_exclude_gtids && !checkpoint ?
+        client.dumpGtid(opt.exclude_gtids, server_id, !opt.stop_never) :
+        checkpoint ?
+        client.dump(checkpoint->binlog_name, checkpoint->position, server_id, !opt.stop_never) :
+        client.dump(binlog_name, opt.start_position, server_id, !opt.stop_never);
+
+    MySQLBinlog parser;
+
+    if(!dumping || !parser.open(&client)) {
+        cerr << "binlog dump failed " << binlog_name << endl;
+        return false;
+    }
+
+    if (!sql) printBinlogInfo(parser);
+
+    const bool succeeded = printEvents(parser, opt, checkpoint, fanout, sql);
+
+    parser.close();
+    client.close();
+
+    return succeeded;
+}
+
+int main(int argc, const char* argv[]) {
+
+    Options opt;
+
+    if (!parseOptions(argc, argv, opt)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (opt.gtid_summary) {
+        return printGtidSummary(opt) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Checkpoint checkpoint;
+    Checkpoint* const resume = opt.checkpoint_path.empty() ? NULL : &checkpoint;
+    if (resume && !checkpoint.load(opt.checkpoint_path)) {
+        return EXIT_FAILURE;
+    }
+
+    FanoutPublisher publisher;
+    if (!opt.publish_name.empty() &&
+        !publisher.open(opt.publish_name, opt.ring_size, opt.max_consumers, opt.drop_slow_consumers)) {
+        return EXIT_FAILURE;
+    }
+
+    SQLWriter writer(cout, opt.packet_size, opt.column_names);
+    SQLWriter* const sql = opt.sql_format ? &writer : NULL;
+
+    if (!opt.host.empty() || !opt.socket_path.empty()) {
+        FanoutOutput* fanout = opt.publish_name.empty() ? NULL : new FanoutOutput(cout, publisher);
+        const bool succeeded = printRemoteBinlog(opt.src_files[0], opt, resume, fanout, sql);
+        delete fanout;
+        return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!opt.heatmap_format.empty()) {
+        HeatMap heat_map(opt.bucket_seconds);
+        for(vector<const char*>::const_iterator it = opt.src_files.begin(); it != opt.src_files.end(); ++it)
+            if (!heat_map.scan(*it)) return EXIT_FAILURE;
+        if (opt.heatmap_format == "json") heat_map.printJSON(cout);
+        else heat_map.printCSV(cout);
+        return EXIT_SUCCESS;
+    }
+
+    if (!opt.predicates.empty()) {
+        Searcher searcher(opt.predicates, opt.num_of_threads);
+        return searcher.run(opt.src_files, cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (opt.checksum) {
+        ChangeChecksum checksum(opt.bucket_seconds, opt.num_of_threads);
+        if (!checksum.run(opt.src_files)) return EXIT_FAILURE;
+        checksum.print(cout);
+        return EXIT_SUCCESS;
+    }
+
+    if (opt.flashback) {
+        Flashback flashback(opt.has_include_gtids ? &opt.include_gtids : NULL,
+                            opt.has_exclude_gtids ? &opt.exclude_gtids : NULL,
+                            opt.packet_size, opt.column_names);
+        return flashback.run(opt.src_files, cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (opt.sample_rate > 0) {
+        Sampler sampler(opt.sample_rate);
+        if (!sampler.scan(opt.src_files)) return EXIT_FAILURE;
+        sampler.print(cout);
+        return EXIT_SUCCESS;
+    }
+
+    if (opt.fingerprint) {
+        Fingerprinter fingerprinter;
+        for(vector<const char*>::const_iterator it = opt.src_files.begin(); it != opt.src_files.end(); ++it)
+            if (!fingerprinter.scan(*it)) return EXIT_FAILURE;
+        fingerprinter.print(cout, opt.top);
+        return EXIT_SUCCESS;
+    }
+
+    if (!opt.compact_key_columns.empty()) {
+        Compactor compactor(opt.compact_key_columns, opt.memory_budget);
+        for(vector<const char*>::const_iterator it = opt.src_files.begin(); it != opt.src_files.end(); ++it)
+            if (!compactor.scan(*it)) return EXIT_FAILURE;
+        return compactor.print(cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (!opt.output_dir.empty()) {
+        ShardWriter writer(opt.output_dir, opt.partition_by, opt.hash_column,
+                           opt.num_of_partitions, opt.num_of_writers, opt.max_open_files);
+        if (!writer.open()) return EXIT_FAILURE;
+        for(vector<const char*>::const_iterator it = opt.src_files.begin(); it != opt.src_files.end(); ++it)
+            if (!writer.scan(*it)) return EXIT_FAILURE;
+        return writer.close() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const bool filter_gtids = opt.has_include_gtids || opt.has_exclude_gtids;
+
+    vector<GtidSet> previous_gtids(opt.src_files.size());
+    vector<bool> has_previous_gtids(opt.src_files.size(), false);
+    if (filter_gtids) {
+        for(size_t i = 0; i < opt.src_files.size(); ++i)
+            has_previous_gtids[i] = readPreviousGtids(opt.src_files[i], previous_gtids[i]);
+    }
+
+    size_t first_file = 0;
+    if (resume && !checkpoint.empty()) {
+        while (first_file < opt.src_files.size() &&
+               Poco::Path(opt.src_files[first_file]).getFileName() != checkpoint.binlog_name) ++first_file;
+        if (first_file == opt.src_files.size()) {
+            cerr << "checkpoint binlog " << checkpoint.binlog_name << " is not among the input files" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    FanoutOutput* fanout = opt.publish_name.empty() ? NULL : new FanoutOutput(cout, publisher);
+    bool succeeded = true;
+
+    for(size_t i = first_file; succeeded && i < opt.src_files.size(); ++i) {
+        if (filter_gtids && has_previous_gtids[i]) {
+            const bool has_next = i + 1 < opt.src_files.size() && has_previous_gtids[i + 1];
+            if (canSkipFile(opt, previous_gtids[i], has_next ? &previous_gtids[i + 1] : NULL))
+                continue;
+        }
+        succeeded = printBinlog(opt.src_files[i], opt, resume, fanout, sql);
+    }
+
+    delete fanout;
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 }
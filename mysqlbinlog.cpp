@@ -2,14 +2,14 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 using namespace std;
 
-int bytes2dec(const char *bytes, const int BYTE_SIZE) {
-    int decsum = 0;
-    for(int i = 0; i < BYTE_SIZE; ++i) {
-        int d = (int)(unsigned char)(bytes[i]);
-        for(int j = 0; j < i; ++j) d *= 256;
-        decsum += d;
+long long unsigned int bytes2dec(const char *bytes, const int BYTE_SIZE) {
+    long long unsigned int decsum = 0;
+    for(int i = BYTE_SIZE - 1; i >= 0; --i) {
+        decsum = (decsum << 8) | (unsigned char)(bytes[i]);
     }
     return decsum;
 }
@@ -44,6 +44,23 @@ long long unsigned int unpack_packed_integer(const char* data) {
     return packed_integer;
 }
 
+int packed_integer_size(const char* data) {
+    const int packed_integer_type = bytes2dec(data, 1);
+    if (packed_integer_type < 251) return 1;
+    else if (packed_integer_type == 252) return 3;
+    else if (packed_integer_type == 253) return 4;
+    else if (packed_integer_type == 254) return 9;
+    return 1;
+}
+
+// Bytes of a DECIMAL(precision, scale) value: 4 per 9 digits, and fewer for
+// the leftover digits, on each side of the point.
+int decimal_bin_size(int precision, int scale) {
+    static const int DIG2BYTES[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    const int intg = precision - scale;
+    return (intg / 9) * 4 + DIG2BYTES[intg % 9] + (scale / 9) * 4 + DIG2BYTES[scale % 9];
+}
+
 string int2str(long long unsigned int n) {
     stringstream ss;
     ss << n << flush;
@@ -61,12 +78,20 @@ MySQLBinlog::MySQLBinlog() {
     m_server_id_bytes = new char[SERVER_ID_BYTE_SIZE];
     m_event_length_bytes = new char[EVENT_LENGTH_BYTE_SIZE];
     m_next_position_bytes = new char[NEXT_POSITION_BYTE_SIZE];
+    m_flags_bytes = new char[FLAGS_BYTE_SIZE];
     m_binlog_format_version_bytes = new char[BINLOG_FORMAT_VERSION_BYTE_SIZE];
     m_server_version_bytes = new char[SERVER_VERSION_BYTE_SIZE];
     m_header_length_bytes = new char[HEADER_LENGTH_BYTE_SIZE];
     m_header_length_bytes[0] = HEADER_SIZE_OF_FORMAT_DESCRIPTION_EVENT;
     m_data_size = 0;
-    m_data = new char[m_data_size];
+    m_data_capacity = 0;
+    m_data = new char[m_data_capacity];
+    m_position = 0;
+    m_source = NULL;
+    m_event = NULL;
+    m_event_size = 0;
+    m_event_pos = 0;
+    m_checksum_alg = BINLOG_CHECKSUM_ALG_OFF;
 }
 
 MySQLBinlog::~MySQLBinlog() {
@@ -75,6 +100,7 @@ MySQLBinlog::~MySQLBinlog() {
     delete[] m_server_id_bytes;
     delete[] m_event_length_bytes;
     delete[] m_next_position_bytes;
+    delete[] m_flags_bytes;
     delete[] m_binlog_format_version_bytes;
     delete[] m_server_version_bytes;
     delete[] m_header_length_bytes;
@@ -83,24 +109,37 @@ MySQLBinlog::~MySQLBinlog() {
 
 bool MySQLBinlog::open(const char *src_file) {
     m_src.open(src_file, ios::in | ios::binary);
+    m_position = 0;
     return m_src.is_open() && checkBinlog();
 }
 
+bool MySQLBinlog::open(EventSource* source) {
+    m_source = source;
+    m_position = 0;
+    return checkBinlog();
+}
+
 bool MySQLBinlog::checkBinlog() {
-    const int MAGIC_BYTE_SIZE = 4;
-    char buf[MAGIC_BYTE_SIZE];
-    m_src.read(buf, sizeof buf);
-    if(m_src.fail() || m_src.gcount() != MAGIC_BYTE_SIZE) {
-        return false;
-    }
-    if(!(buf[0] == static_cast<char>(0xfe) &&
-         buf[1] == static_cast<char>(0x62) &&
-         buf[2] == static_cast<char>(0x69) &&
-         buf[3] == static_cast<char>(0x6e))) {
-        cerr << "input file is not mysql binlog" << endl;
-        return false;
+    if(!m_source) {
+        const int MAGIC_BYTE_SIZE = 4;
+        char buf[MAGIC_BYTE_SIZE];
+        m_src.read(buf, sizeof buf);
+        m_position += MAGIC_BYTE_SIZE;
+        if(m_src.fail() || m_src.gcount() != MAGIC_BYTE_SIZE) {
+            return false;
+        }
+        if(!(buf[0] == static_cast<char>(0xfe) &&
+             buf[1] == static_cast<char>(0x62) &&
+             buf[2] == static_cast<char>(0x69) &&
+             buf[3] == static_cast<char>(0x6e))) {
+            cerr << "input file is not mysql binlog" << endl;
+            return false;
+        }
     }
-    if(!(readHeader() && m_type_code_bytes[0] == FORMAT_DESCRIPTION_EVENT)) {
+    bool has_header = readHeader();
+    // a dump stream starts with an artificial ROTATE_EVENT naming the file
+    while(has_header && m_source && m_type_code_bytes[0] == ROTATE_EVENT) has_header = readHeader();
+    if(!(has_header && m_type_code_bytes[0] == FORMAT_DESCRIPTION_EVENT)) {
         cerr << "cannot read FORMAT_DESCRIPTION_EVENT" << endl;
         return false;
     }
@@ -116,6 +155,16 @@ bool MySQLBinlog::checkBinlog() {
     return true;
 }
 
+// Servers since 5.6.1 end FORMAT_DESCRIPTION_EVENT with the checksum
+// algorithm byte followed by the event's own 4 byte checksum.
+bool MySQLBinlog::HasChecksumAlgorithm(const char* server_version) {
+    int major = 0, minor = 0, patch = 0;
+    sscanf(server_version, "%d.%d.%d", &major, &minor, &patch);
+    if(major != 5) return major > 5;
+    if(minor != 6) return minor > 6;
+    return patch >= 1;
+}
+
 std::string MySQLBinlog::getServerVersion() const {
     stringstream ss;
     ss << m_server_version_bytes << flush;
@@ -127,60 +176,210 @@ int MySQLBinlog::getServerId() const {
 }
 
 bool MySQLBinlog::readData(TypeCode type) {
+    bool ok = true;
     if (type == FORMAT_DESCRIPTION_EVENT) {
-        m_src.clear();
-        m_src.read(m_binlog_format_version_bytes, BINLOG_FORMAT_VERSION_BYTE_SIZE);
-        m_src.read(m_server_version_bytes, SERVER_VERSION_BYTE_SIZE);
-        m_src.seekg(TIMESTAMP_BYTE_SIZE, ios::cur);
-        m_src.read(m_header_length_bytes, HEADER_LENGTH_BYTE_SIZE);
+        const int FIXED_DATA_BYTE_SIZE = BINLOG_FORMAT_VERSION_BYTE_SIZE + SERVER_VERSION_BYTE_SIZE
+            + TIMESTAMP_BYTE_SIZE + HEADER_LENGTH_BYTE_SIZE;
+        const int remaining_data_size = bytes2dec(m_event_length_bytes, EVENT_LENGTH_BYTE_SIZE) -
+            bytes2dec(m_header_length_bytes, HEADER_LENGTH_BYTE_SIZE) - FIXED_DATA_BYTE_SIZE;
+        ok = readBytes(m_binlog_format_version_bytes, BINLOG_FORMAT_VERSION_BYTE_SIZE)
+            && readBytes(m_server_version_bytes, SERVER_VERSION_BYTE_SIZE)
+            && skipBytes(TIMESTAMP_BYTE_SIZE)
+            && readBytes(m_header_length_bytes, HEADER_LENGTH_BYTE_SIZE);
+        m_server_version_bytes[SERVER_VERSION_BYTE_SIZE - 1] = '\0';
+
+        m_checksum_alg = BINLOG_CHECKSUM_ALG_OFF;
+        if(ok && remaining_data_size >= CHECKSUM_ALG_BYTE_SIZE + CHECKSUM_BYTE_SIZE &&
+           HasChecksumAlgorithm(m_server_version_bytes)) {
+            vector<char> post_header(remaining_data_size);
+            ok = readBytes(&post_header[0], remaining_data_size);
+            m_checksum_alg = static_cast<unsigned char>
+                (post_header[remaining_data_size - CHECKSUM_ALG_BYTE_SIZE - CHECKSUM_BYTE_SIZE]);
+        }
     }
     else {
-        const int _data_size = bytes2dec(m_event_length_bytes, EVENT_LENGTH_BYTE_SIZE) -
+        int _data_size = bytes2dec(m_event_length_bytes, EVENT_LENGTH_BYTE_SIZE) -
             bytes2dec(m_header_length_bytes, HEADER_LENGTH_BYTE_SIZE);
-        if(_data_size > m_data_size) {
+        if(m_checksum_alg == BINLOG_CHECKSUM_ALG_CRC32) _data_size -= CHECKSUM_BYTE_SIZE;
+        if(_data_size < 0) return false;
+        if(_data_size > m_data_capacity) {
             delete[] m_data;
             m_data = new char[_data_size];
+            m_data_capacity = _data_size;
         }
         m_data_size = _data_size;
-        m_src.read(m_data, m_data_size);
+        ok = readBytes(m_data, m_data_size);
+        if(ok && ToRowsEventV1(type) != type) ok = dropRowsExtraData();
+    }
+    return ok;
+}
+
+// The v2 rows events that MySQL 5.6 and later write differ from v1 only by
+// an extra_data block after the table id and flags, its 2 byte length
+// counting itself. Dropping it leaves a v1 body, so callers handle both
+// versions as one.
+bool MySQLBinlog::dropRowsExtraData() {
+    const int POST_HEADER_BYTE_SIZE = 8;
+    const int EXTRA_DATA_LENGTH_BYTE_SIZE = 2;
+    if(m_data_size < POST_HEADER_BYTE_SIZE + EXTRA_DATA_LENGTH_BYTE_SIZE) return false;
+    const int extra_data_size = bytes2dec(m_data + POST_HEADER_BYTE_SIZE, EXTRA_DATA_LENGTH_BYTE_SIZE);
+    if(extra_data_size < EXTRA_DATA_LENGTH_BYTE_SIZE ||
+       POST_HEADER_BYTE_SIZE + extra_data_size > m_data_size) {
+        cerr << "invalid extra_data in rows event" << endl;
+        return false;
+    }
+    copy(m_data + POST_HEADER_BYTE_SIZE + extra_data_size, m_data + m_data_size, m_data + POST_HEADER_BYTE_SIZE);
+    m_data_size -= extra_data_size;
+    return true;
+}
+
+TypeCode MySQLBinlog::ToRowsEventV1(TypeCode type) {
+    switch(type) {
+        case WRITE_ROWS_EVENT_V2: return WRITE_ROWS_EVENT;
+        case UPDATE_ROWS_EVENT_V2: return UPDATE_ROWS_EVENT;
+        case DELETE_ROWS_EVENT_V2: return DELETE_ROWS_EVENT;
+        default: return type;
     }
-    return !m_src.fail();
 }
 
 bool MySQLBinlog::readHeader() {
-    m_src.clear();
-    m_src.read(m_timestamp_bytes, TIMESTAMP_BYTE_SIZE);
-    m_src.read(m_type_code_bytes, TYPE_CODE_BYTE_SIZE);
-    m_src.read(m_server_id_bytes, SERVER_ID_BYTE_SIZE);
-    m_src.read(m_event_length_bytes, EVENT_LENGTH_BYTE_SIZE);
-    m_src.read(m_next_position_bytes, NEXT_POSITION_BYTE_SIZE);
-    m_src.seekg(FLAGS_BYTE_SIZE, ios::cur);
-    int remaining_header_byte_size = m_header_length_bytes[0] -
-        (TIMESTAMP_BYTE_SIZE
-         + TYPE_CODE_BYTE_SIZE
-         + SERVER_ID_BYTE_SIZE
-         + EVENT_LENGTH_BYTE_SIZE
-         + NEXT_POSITION_BYTE_SIZE
-         + FLAGS_BYTE_SIZE
-         );
-    m_src.seekg(remaining_header_byte_size, ios::cur);
+    if(m_source) {
+        m_event_pos = 0;
+        if(!m_source->next(m_event, m_event_size)) return false;
+    }
+    else {
+        m_src.clear();
+    }
+    const int COMMON_HEADER_BYTE_SIZE = TIMESTAMP_BYTE_SIZE
+        + TYPE_CODE_BYTE_SIZE
+        + SERVER_ID_BYTE_SIZE
+        + EVENT_LENGTH_BYTE_SIZE
+        + NEXT_POSITION_BYTE_SIZE
+        + FLAGS_BYTE_SIZE;
+    int remaining_header_byte_size = m_header_length_bytes[0] - COMMON_HEADER_BYTE_SIZE;
+
+    // one read per header instead of one per field; the stream calls, not
+    // the copies, are what a scan over millions of small events pays for
+    char header[COMMON_HEADER_BYTE_SIZE];
+    if(!readBytes(header, COMMON_HEADER_BYTE_SIZE)) return false;
+    const char* field = header;
+    memcpy(m_timestamp_bytes, field, TIMESTAMP_BYTE_SIZE);
+    field += TIMESTAMP_BYTE_SIZE;
+    memcpy(m_type_code_bytes, field, TYPE_CODE_BYTE_SIZE);
+    field += TYPE_CODE_BYTE_SIZE;
+    memcpy(m_server_id_bytes, field, SERVER_ID_BYTE_SIZE);
+    field += SERVER_ID_BYTE_SIZE;
+    memcpy(m_event_length_bytes, field, EVENT_LENGTH_BYTE_SIZE);
+    field += EVENT_LENGTH_BYTE_SIZE;
+    memcpy(m_next_position_bytes, field, NEXT_POSITION_BYTE_SIZE);
+    field += NEXT_POSITION_BYTE_SIZE;
+    memcpy(m_flags_bytes, field, FLAGS_BYTE_SIZE);
+    return skipBytes(remaining_header_byte_size);
+}
+
+bool MySQLBinlog::readBytes(char* dst, int byte_size) {
+    if(m_source) {
+        if(m_event_pos + byte_size > m_event_size) return false;
+        copy(m_event + m_event_pos, m_event + m_event_pos + byte_size, dst);
+        m_event_pos += byte_size;
+        return true;
+    }
+    m_src.read(dst, byte_size);
+    m_position += byte_size;
+    return !m_src.fail();
+}
+
+bool MySQLBinlog::skipBytes(int byte_size) {
+    if(m_source) {
+        m_event_pos += byte_size;
+        return m_event_pos <= m_event_size;
+    }
+    m_src.ignore(byte_size);
+    m_position += byte_size;
     return !m_src.fail();
 }
 
 bool MySQLBinlog::read() {
+    return readEventHeader() && readEventData();
+}
+
+bool MySQLBinlog::readEventHeader() {
+    if(m_source) {
+        // the server repeats FORMAT_DESCRIPTION_EVENT after every rotation,
+        // announces each file with an artificial ROTATE_EVENT and sends
+        // heartbeats while idle; none of them reaches the caller
+        const int FLAGS_OFFSET = TIMESTAMP_BYTE_SIZE + TYPE_CODE_BYTE_SIZE + SERVER_ID_BYTE_SIZE
+            + EVENT_LENGTH_BYTE_SIZE + NEXT_POSITION_BYTE_SIZE;
+        for(;;) {
+            if(!readHeader()) return false;
+            if(m_type_code_bytes[0] == FORMAT_DESCRIPTION_EVENT) {
+                if(!readData(FORMAT_DESCRIPTION_EVENT)) return false;
+                continue;
+            }
+            if(m_type_code_bytes[0] == ROTATE_EVENT && (m_event[FLAGS_OFFSET] & LOG_EVENT_ARTIFICIAL_F)) continue;
+            if(m_type_code_bytes[0] != HEARTBEAT_LOG_EVENT) return true;
+        }
+    }
     m_src.clear();
-    m_src.seekg(bytes2dec(m_next_position_bytes, NEXT_POSITION_BYTE_SIZE));
-    return readHeader() && readData(static_cast<TypeCode>(m_type_code_bytes[0]));
+    seek(bytes2dec(m_next_position_bytes, NEXT_POSITION_BYTE_SIZE));
+    return readHeader();
+}
+
+// Seeking a filebuf drops its buffer and costs a system call, so events that
+// are stepped over by header are skipped by reading through the buffer instead.
+void MySQLBinlog::seek(int position) {
+    const int SKIP_BY_READ_LIMIT = 64 * 1024;
+    const int gap = position - m_position;
+    if(gap == 0) return;
+    if(gap > 0 && gap <= SKIP_BY_READ_LIMIT) m_src.ignore(gap);
+    else m_src.seekg(position);
+    m_position = position;
+}
+
+bool MySQLBinlog::readEventData() {
+    return readData(static_cast<TypeCode>(m_type_code_bytes[0]));
+}
+
+TypeCode MySQLBinlog::getTypeCode() const {
+    return ToRowsEventV1(static_cast<TypeCode>(bytes2dec(m_type_code_bytes, TYPE_CODE_BYTE_SIZE)));
+}
+
+int MySQLBinlog::getTimestamp() const {
+    return bytes2dec(m_timestamp_bytes, TIMESTAMP_BYTE_SIZE);
+}
+
+int MySQLBinlog::getEventLength() const {
+    return bytes2dec(m_event_length_bytes, EVENT_LENGTH_BYTE_SIZE);
+}
+
+int MySQLBinlog::getPosition() const {
+    return bytes2dec(m_next_position_bytes, NEXT_POSITION_BYTE_SIZE) - getEventLength();
+}
+
+int MySQLBinlog::getNextPosition() const {
+    return bytes2dec(m_next_position_bytes, NEXT_POSITION_BYTE_SIZE);
+}
+
+int MySQLBinlog::getFlags() const {
+    return bytes2dec(m_flags_bytes, FLAGS_BYTE_SIZE);
+}
+
+// Makes the next readEventHeader() of a file read the event at position,
+// which must be an event boundary such as a saved getNextPosition().
+void MySQLBinlog::setNextPosition(int position) {
+    for(int i = 0; i < NEXT_POSITION_BYTE_SIZE; ++i)
+        m_next_position_bytes[i] = static_cast<char>((position >> (8 * i)) & 0xFF);
 }
 
 bool MySQLBinlog::close() {
+    m_source = NULL;
     m_src.close();
     return !m_src.is_open();
 }
 
 Event* MySQLBinlog::getEvent(const TableMap& table_map, const MetaMap& meta_map) {
     const int timestamp = bytes2dec(m_timestamp_bytes, TIMESTAMP_BYTE_SIZE);
-    const TypeCode type_code = static_cast<TypeCode>(bytes2dec(m_type_code_bytes, TYPE_CODE_BYTE_SIZE));
+    const TypeCode type_code = getTypeCode();
     return new Event(timestamp, type_code, m_data, m_data_size, table_map, meta_map);
 }
 
@@ -204,6 +403,8 @@ Event::Event(int timestamp, TypeCode type_code, const char* data, int data_size,
     m_table_name_size = 0;
     m_table_name = new char[m_table_name_size];
 
+    m_gtid_gno = 0;
+
     m_num_of_columns = 0;
     m_column_types = new ColumnType[m_num_of_columns];
     m_metadata_block_size = 0;
@@ -213,6 +414,8 @@ Event::Event(int timestamp, TypeCode type_code, const char* data, int data_size,
 
     if (QUERY_EVENT == type_code) parseQueryEventData() || cerr << "parse failed QUERY_EVENT" << endl;
     if (ROTATE_EVENT == type_code) parseRotateEventData() || cerr << "parse failed ROTATE_EVENT" << endl;
+    if (GTID_LOG_EVENT == type_code) parseGtidEventData() || cerr << "parse failed GTID_LOG_EVENT" << endl;
+    if (PREVIOUS_GTIDS_LOG_EVENT == type_code) parsePreviousGtidsEventData() || cerr << "parse failed PREVIOUS_GTIDS_LOG_EVENT" << endl;
     if (TABLE_MAP_EVENT == type_code) parseTableMapEventData() || cerr << "parse failed TABLE_MAP_EVENT" << endl;
     if (WRITE_ROWS_EVENT == type_code) parseWriteRowsEventData(table_map, meta_map) || cerr << "parse failed WRITE_ROWS_EVENT" << endl;
     if (UPDATE_ROWS_EVENT == type_code) parseUpdateRowsEventData(table_map, meta_map) || cerr << "parse failed UPDATE_ROWS_EVENT" << endl;
@@ -269,6 +472,19 @@ string Event::getSQLStatement() const {
     return ss.str();
 }
 
+// Locates the statement of QUERY_EVENT data in place, for callers that
+// must not copy it. Returns NULL when the data is truncated.
+const char* Event::ReadSQLStatement(const char* data, int data_size, int& sql_statement_size) {
+    const int POST_HEADER_BYTE_SIZE = 13;
+    if(data_size < POST_HEADER_BYTE_SIZE) return NULL;
+    const int dbname_size = bytes2dec(data + 8, 1);
+    const int status_variable_size = bytes2dec(data + 11, 2);
+    const int pos = POST_HEADER_BYTE_SIZE + status_variable_size + dbname_size + 1;
+    if(pos > data_size) return NULL;
+    sql_statement_size = data_size - pos;
+    return data + pos;
+}
+
 string Event::getNextBinlogName() const {
     stringstream ss;
     ss << m_next_binlog_name << flush;
@@ -295,9 +511,54 @@ bool Event::parseRotateEventData() {
     return true;
 }
 
+bool Event::parseGtidEventData() {
+    const int SID_BYTE_SIZE = 16;
+    const int GNO_BYTE_SIZE = 8;
+    int pos = 1;
+    if(m_data_size < pos + SID_BYTE_SIZE + GNO_BYTE_SIZE) {
+        cerr << "GTID_LOG_EVENT is too short" << endl;
+        return false;
+    }
+    m_gtid_sid = GtidSet::FormatSid(m_data + pos);
+    m_gtid_gno = bytes2dec(m_data + (pos += SID_BYTE_SIZE), GNO_BYTE_SIZE);
+    return true;
+}
+
+bool Event::parsePreviousGtidsEventData() {
+    const int SID_BYTE_SIZE = 16;
+    const int COUNT_BYTE_SIZE = 8;
+    const int GNO_BYTE_SIZE = 8;
+    int pos = 0;
+    if(m_data_size < COUNT_BYTE_SIZE) return false;
+    const long long unsigned int num_of_sids = bytes2dec(m_data, COUNT_BYTE_SIZE);
+    pos += COUNT_BYTE_SIZE;
+
+    m_previous_gtids.clear();
+    for(long long unsigned int i = 0; i < num_of_sids; ++i) {
+        if(m_data_size < pos + SID_BYTE_SIZE + COUNT_BYTE_SIZE) {
+            cerr << "PREVIOUS_GTIDS_LOG_EVENT is truncated" << endl;
+            return false;
+        }
+        const string sid = GtidSet::FormatSid(m_data + pos);
+        const long long unsigned int num_of_intervals = bytes2dec(m_data + (pos += SID_BYTE_SIZE), COUNT_BYTE_SIZE);
+        pos += COUNT_BYTE_SIZE;
+        if((long long unsigned int)(m_data_size - pos) < num_of_intervals * GNO_BYTE_SIZE * 2) {
+            cerr << "PREVIOUS_GTIDS_LOG_EVENT is truncated" << endl;
+            return false;
+        }
+        for(long long unsigned int j = 0; j < num_of_intervals; ++j) {
+            const long long start = bytes2dec(m_data + pos, GNO_BYTE_SIZE);
+            const long long end = bytes2dec(m_data + (pos += GNO_BYTE_SIZE), GNO_BYTE_SIZE);
+            pos += GNO_BYTE_SIZE;
+            m_previous_gtids.addInterval(sid, start, end);
+        }
+    }
+    return true;
+}
+
 bool Event::parseTableMapEventData() {
     int pos = 0;
-    const int table_id = bytes2dec(m_data, 6);
+    const TableId table_id = ReadTableId(m_data);
     const int database_name_size = bytes2dec
         (m_data + (pos += 8), 1);
     char* database_name = new char[database_name_size + 1];
@@ -316,15 +577,13 @@ bool Event::parseTableMapEventData() {
     }
     const int num_of_columns = unpack_packed_integer(m_data + (pos += 1));
     ColumnType* column_types = new ColumnType[num_of_columns];
-    for(int i = 0; i < num_of_columns; ++i) column_types[i] = static_cast<ColumnType>(m_data[++pos]);
+    for(int i = 0; i < num_of_columns; ++i) column_types[i] = static_cast<ColumnType>(static_cast<unsigned char>(m_data[++pos]));
     const long long unsigned int metadata_block_size = unpack_packed_integer(m_data + (pos += 1));
-    int packed_integer_type = bytes2dec(m_data, 1);
-    if (packed_integer_type < 252) pos += 1;
-    else if (packed_integer_type == 252) pos += 3;
-    else if (packed_integer_type == 253) pos += 4;
-    else if (packed_integer_type == 254) pos += 9;
+    pos += packed_integer_size(m_data + pos);
     char* metadata_block = new char[metadata_block_size];
     for(long long unsigned int i = 0; i < metadata_block_size; ++i) metadata_block[i] = m_data[pos++];
+    pos += (num_of_columns + 7) / 8;
+    parseOptionalMetadata(pos, num_of_columns, column_types);
 
     m_table_id = table_id;
     m_num_of_columns = num_of_columns;
@@ -347,6 +606,75 @@ bool Event::parseTableMapEventData() {
     return true;
 }
 
+// MySQL 8.0 servers with binlog_row_metadata=FULL append type-length-value
+// fields after the null bitmap; only signedness and column names are kept.
+void Event::parseOptionalMetadata(int pos, int num_of_columns, const ColumnType* column_types) {
+    const int SIGNEDNESS = 1;
+    const int COLUMN_NAME = 4;
+    m_unsigned_columns.assign(num_of_columns, 0);
+    m_column_names.clear();
+    while(pos < m_data_size) {
+        const int field_type = static_cast<unsigned char>(m_data[pos++]);
+        if(pos >= m_data_size) break;
+        const int field_size = unpack_packed_integer(m_data + pos);
+        pos += packed_integer_size(m_data + pos);
+        const int end = pos + field_size;
+        if(end > m_data_size) break;
+
+        if(SIGNEDNESS == field_type) {
+            // one bit per numeric column, most significant first
+            for(int i = 0, bit = 0; i < num_of_columns; ++i) {
+                switch(column_types[i]) {
+                    case MYSQL_TYPE_TINY:
+                    case MYSQL_TYPE_SHORT:
+                    case MYSQL_TYPE_INT24:
+                    case MYSQL_TYPE_LONG:
+                    case MYSQL_TYPE_LONGLONG:
+                    case MYSQL_TYPE_FLOAT:
+                    case MYSQL_TYPE_DOUBLE:
+                    case MYSQL_TYPE_DECIMAL:
+                    case MYSQL_TYPE_NEWDECIMAL:
+                        if(pos + bit / 8 < end)
+                            m_unsigned_columns[i] = (m_data[pos + bit / 8] >> (7 - bit % 8)) & 1;
+                        ++bit;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        else if(COLUMN_NAME == field_type) {
+            int name_pos = pos;
+            while(name_pos < end && static_cast<int>(m_column_names.size()) < num_of_columns) {
+                const int name_size = unpack_packed_integer(m_data + name_pos);
+                name_pos += packed_integer_size(m_data + name_pos);
+                if(name_pos + name_size > end) break;
+                m_column_names.push_back(string(m_data + name_pos, name_size));
+                name_pos += name_size;
+            }
+            if(static_cast<int>(m_column_names.size()) != num_of_columns) m_column_names.clear();
+        }
+        pos = end;
+    }
+}
+
+void Event::storeTableMap(TableMap& table_map, MetaMap& meta_map) const {
+    table_map[m_table_id] = pss(getDBName(), getTableName());
+
+    vector<ColumnType> vc(m_num_of_columns);
+    vector<int> vi(m_num_of_columns);
+    for(int i = 0; i < m_num_of_columns; ++i) {
+        vc[i] = getColumnType(i);
+        vi[i] = getMetadata(i);
+    }
+    meta_map[m_table_id] = pvv(vc,vi);
+}
+
+TableId Event::ReadTableId(const char* data) {
+    const int TABLE_ID_BYTE_SIZE = 6;
+    return bytes2dec(data, TABLE_ID_BYTE_SIZE);
+}
+
 ColumnType Event::getColumnType(int column_index) const {
     return m_column_types[column_index];
 }
@@ -361,6 +689,9 @@ int Event::getMetadata(int column_index) const {
             case MYSQL_TYPE_DOUBLE:
             case MYSQL_TYPE_BLOB:
             case MYSQL_TYPE_GEOMETRY:
+            case MYSQL_TYPE_TIMESTAMP2:
+            case MYSQL_TYPE_DATETIME2:
+            case MYSQL_TYPE_TIME2:
                 metadata_size = 1;
                 break;
             case MYSQL_TYPE_VARCHAR:
@@ -368,6 +699,8 @@ int Event::getMetadata(int column_index) const {
             case MYSQL_TYPE_NEWDECIMAL:
             case MYSQL_TYPE_VAR_STRING:
             case MYSQL_TYPE_STRING:
+            case MYSQL_TYPE_ENUM:
+            case MYSQL_TYPE_SET:
                 metadata_size = 2;
                 break;
             default:
@@ -381,9 +714,31 @@ int Event::getMetadata(int column_index) const {
         cerr << "invalid metadata access" << endl;
         exit(EXIT_FAILURE);
     }
+    const ColumnType ctype = m_column_types[column_index];
+    if(MYSQL_TYPE_NEWDECIMAL == ctype || MYSQL_TYPE_STRING == ctype ||
+       MYSQL_TYPE_ENUM == ctype || MYSQL_TYPE_SET == ctype) {
+        // (precision, scale) and (real type, length) are stored high byte first
+        return (static_cast<unsigned char>(m_metadata_block[pos]) << 8)
+            | static_cast<unsigned char>(m_metadata_block[pos + 1]);
+    }
     return bytes2dec(m_metadata_block + pos, metadata_size);
 }
 
+// Strings are prefixed with their length in one byte, or in two when the
+// column may hold more than 255 bytes. STRING keeps the high bits of its
+// maximum length in the otherwise unused bits of its real type.
+int Event::GetLengthPrefixSize(ColumnType ctype, unsigned int meta) {
+    unsigned int max_length = meta;
+    if (MYSQL_TYPE_STRING == ctype) {
+        const unsigned int byte0 = meta >> 8;
+        max_length = meta & 0xFF;
+        if (meta >= 256 && (byte0 & 0x30) != 0x30) {
+            max_length |= ((byte0 & 0x30) ^ 0x30) << 4;
+        }
+    }
+    return max_length < 256 ? 1 : 2;
+}
+
 int Event::GetColumnImageSize(ColumnType ctype, unsigned int meta, const char* data) {
     int csize = 0;
     switch(ctype) {
@@ -395,6 +750,7 @@ int Event::GetColumnImageSize(ColumnType ctype, unsigned int meta, const char* d
             csize = 2;
             break;
         case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_DATE:
         case MYSQL_TYPE_TIME:
         case MYSQL_TYPE_NEWDATE:
             csize = 3;
@@ -415,20 +771,17 @@ int Event::GetColumnImageSize(ColumnType ctype, unsigned int meta, const char* d
 
     if (MYSQL_TYPE_VARCHAR == ctype ||
         MYSQL_TYPE_VAR_STRING == ctype) {
-        csize = (int)(unsigned char)(data[0]) + (meta < 256 ? 1 : 2);
+        const int prefix = GetLengthPrefixSize(ctype, meta);
+        csize = bytes2dec(data, prefix) + prefix;
     }
     else if (MYSQL_TYPE_STRING == ctype) {
-        if (meta >= 256) {
-            unsigned int byte0= meta >> 8;
-            unsigned int byte1= meta & 0xFF;
-            if ((byte0 & 0x30) != 0x30) {
-                meta = byte1 | (((byte0 & 0x30) ^ 0x30) << 4);
-            }
-            else {
-                meta = meta & 0xFF;
-            }
+        const unsigned int byte0 = meta >> 8;
+        if (byte0 == MYSQL_TYPE_ENUM || byte0 == MYSQL_TYPE_SET) {
+            // logged as STRING; the low byte is the pack length of the index or bit set
+            return meta & 0xFF;
         }
-        csize = (int)(unsigned char)(data[0]) + (meta < 256 ? 1 : 2);
+        const int prefix = GetLengthPrefixSize(ctype, meta);
+        csize = bytes2dec(data, prefix) + prefix;
     }
     else if (MYSQL_TYPE_BIT == ctype) {
         unsigned int nbits = ((meta >> 8) * 8) + (meta & 0xFF);
@@ -459,16 +812,12 @@ int Event::GetColumnImageSize(ColumnType ctype, unsigned int meta, const char* d
     else if (MYSQL_TYPE_DATETIME2 == ctype) {
         csize = 5 + (meta + 1) / 2;
     }
-    else if (MYSQL_TYPE_BLOB == ctype) {
-        csize = (int)(unsigned char)(data[0]) + meta;
+    else if (MYSQL_TYPE_BLOB == ctype || MYSQL_TYPE_GEOMETRY == ctype) {
+        // meta is the byte size of the length prefix
+        csize = bytes2dec(data, meta) + meta;
     }
     else if (MYSQL_TYPE_NEWDECIMAL == ctype) {
-        // TODO
-        // unsigned int precision = meta >> 8;
-        // unsigned int decimals = meta & 0xFF;
-        // csize = decimal_bin_size((int)precision, (int)scale);
-        cerr << "do not know how to parse MYSQL_TYPE_NEWDECIMAL" << endl;
-        exit(EXIT_FAILURE);
+        csize = decimal_bin_size(meta >> 8, meta & 0xFF);
     }
     return csize;
 }
@@ -487,79 +836,40 @@ bool Event::parseDeleteRowsEventData(const TableMap& table_map, const MetaMap& m
 
 bool Event::__parseRowsEventData(const TableMap& table_map, const MetaMap& meta_map, bool is_update) {
 
-    int pos = 0;
-    const int table_id = bytes2dec(m_data, 6);
-    const int num_of_columns = unpack_packed_integer(m_data + (pos += 8));
-
-    bool* used_column = new bool[num_of_columns];
-    bool* null_column = new bool[num_of_columns];
+    RowScanner scanner(m_data, m_data_size, meta_map, is_update);
+    if(!scanner.isValid()) return false;
 
-    int mask_byte_size = (num_of_columns + 7) / 8;
+    const int num_of_columns = scanner.getNumOfColumns();
 
-    if(is_update) pos += mask_byte_size * 2;
-    else pos += mask_byte_size;
-
-    for(int i = 0; i < mask_byte_size; ++i) {
-        unsigned char byte = m_data[pos++];
-        for(int j = 0; j < 8; ++j) {
-            int ii = (i * 8) + j;
-            if (ii >= num_of_columns) break;
-            used_column[ii] = byte & (1 << j);
-        }
-    }
-
-    int remaining_byte_size = m_data_size - pos;
-
-    while(remaining_byte_size > 0) {
-
-        int num_of_used_columns = 0;
-        for(int i = 0; i < num_of_columns; ++i)
-            if(used_column[i]) ++num_of_used_columns;
-
-        mask_byte_size = (num_of_used_columns + 7) / 8;
-
-        for(int i = 0, offset = 0; i < mask_byte_size; ++i) {
-            unsigned char byte = m_data[pos++];
-            for(int j = 0; j < 8; ++j) {
-                int ii = (i * 8) + j + offset;
-                while(ii < num_of_columns && !used_column[ii]) {
-                    ++offset;
-                    ++ii;
-                }
-                if (ii >= num_of_columns) break;
-                null_column[ii] = byte & (1 << j);
-            }
-        }
-
-        remaining_byte_size -= mask_byte_size;
+    while(scanner.next()) {
 
         vector<string> row(num_of_columns);
 
         for(int i = 0; i < num_of_columns; ++i) {
 
-            if(!used_column[i]) {
+            if(!scanner.isUsed(i)) {
                 row[i] = "-";
                 continue;
             }
-            else if(null_column[i]) {
+            else if(scanner.isNull(i)) {
                 row[i] = "null";
                 continue;
             }
 
-            const ColumnType ctype = meta_map.at(table_id).first.at(i);
-            const unsigned int meta = static_cast<unsigned int>(meta_map.at(table_id).second.at(i));
-            const int csize = GetColumnImageSize(ctype, meta, m_data + pos);
+            const ColumnType ctype = scanner.getColumnType(i);
+            const char* cdata = scanner.getColumnData(i);
+            const int csize = scanner.getColumnSize(i);
 
             if(ctype ==MYSQL_TYPE_DECIMAL) row[i] = "decimal";
-            else if(ctype == MYSQL_TYPE_TINY) row[i] = int2str(bytes2dec(m_data + pos, csize));
-            else if(ctype == MYSQL_TYPE_SHORT) row[i] = int2str(bytes2dec(m_data + pos, csize));
-            else if(ctype == MYSQL_TYPE_LONG) row[i] = int2str(bytes2dec(m_data + pos, csize));
+            else if(ctype == MYSQL_TYPE_TINY) row[i] = int2str(bytes2dec(cdata, csize));
+            else if(ctype == MYSQL_TYPE_SHORT) row[i] = int2str(bytes2dec(cdata, csize));
+            else if(ctype == MYSQL_TYPE_LONG) row[i] = int2str(bytes2dec(cdata, csize));
             else if(ctype == MYSQL_TYPE_FLOAT) row[i] = "float";
             else if(ctype == MYSQL_TYPE_DOUBLE) row[i] = "double";
             else if(ctype == MYSQL_TYPE_NULL) row[i] = "null";
             else if(ctype == MYSQL_TYPE_TIMESTAMP) row[i] = "timestamp";
-            else if(ctype == MYSQL_TYPE_LONGLONG) row[i] = int2str(bytes2dec(m_data + pos, csize));
-            else if(ctype == MYSQL_TYPE_INT24) row[i] = int2str(bytes2dec(m_data + pos, csize));
+            else if(ctype == MYSQL_TYPE_LONGLONG) row[i] = int2str(bytes2dec(cdata, csize));
+            else if(ctype == MYSQL_TYPE_INT24) row[i] = int2str(bytes2dec(cdata, csize));
             else if(ctype == MYSQL_TYPE_DATE) row[i] = "date";
             else if(ctype == MYSQL_TYPE_TIME) row[i] = "time";
             else if(ctype == MYSQL_TYPE_DATETIME) row[i] = "datetime";
@@ -581,17 +891,208 @@ bool Event::__parseRowsEventData(const TableMap& table_map, const MetaMap& meta_
             else if(ctype == MYSQL_TYPE_STRING) row[i] = "string";
             else if(ctype == MYSQL_TYPE_GEOMETRY) row[i] = "geometry";
             else  row[i] = "unknown";
-
-            pos += csize;
-            remaining_byte_size -= csize;
         }
         m_rows.push_back(row);
     }
 
-    m_table_id = table_id;
+    m_table_id = scanner.getTableId();
+
+    return true;
+}
+
+//******************************
+// TABLE MAP CACHE CLASS
+//******************************
+
+TableMapCache::TableMapCache():
+    m_event(NULL)
+{
+}
+
+TableMapCache::~TableMapCache() {
+    delete m_event;
+}
+
+// Returns whether the TABLE_MAP_EVENT whose body parser holds was decoded.
+bool TableMapCache::store(const MySQLBinlog& parser) {
+    string& last_data = m_data[Event::ReadTableId(parser.getData())];
+    if(last_data.compare(0, string::npos, parser.getData(), parser.getDataSize()) == 0) return false;
+    last_data.assign(parser.getData(), parser.getDataSize());
+    delete m_event;
+    m_event = new Event(parser.getTimestamp(), TABLE_MAP_EVENT, parser.getData(), parser.getDataSize(),
+                        m_table_map, m_meta_map);
+    m_event->storeTableMap(m_table_map, m_meta_map);
+    return true;
+}
+
+//******************************
+// ROW EVENT READER CLASS
+//******************************
+
+bool RowEventReader::open(const char* src_file) {
+    if(!m_parser.open(src_file)) {
+        cerr << "file open failed " << src_file << endl;
+        return false;
+    }
+    return true;
+}
 
-    delete[] null_column;
-    delete[] used_column;
+bool RowEventReader::next() {
+    while(m_parser.readEventHeader()) {
+        const TypeCode type = m_parser.getTypeCode();
+        if(TABLE_MAP_EVENT == type) {
+            if(!m_parser.readEventData()) return false;
+            if(m_table_maps.store(m_parser)) return true;
+        }
+        else if(WRITE_ROWS_EVENT == type ||
+                UPDATE_ROWS_EVENT == type ||
+                DELETE_ROWS_EVENT == type) {
+            return m_parser.readEventData();
+        }
+    }
+    return false;
+}
+
+bool RowEventReader::close() {
+    return m_parser.close();
+}
+
+//******************************
+// TRANSACTION TRACKER CLASS
+//******************************
+
+bool TransactionTracker::endsTransaction(TypeCode type, const char* data, int data_size) {
+    if(GTID_LOG_EVENT == type || ANONYMOUS_GTID_LOG_EVENT == type) {
+        m_in_begin = false;
+        return false;
+    }
+    if(XID_EVENT == type || ROTATE_EVENT == type || STOP_EVENT == type) {
+        m_in_begin = false;
+        return true;
+    }
+    if(QUERY_EVENT != type) return false;
+
+    int sql_statement_size = 0;
+    const char* sql_statement = Event::ReadSQLStatement(data, data_size, sql_statement_size);
+    if(IsStatement(sql_statement, sql_statement_size, "BEGIN")) {
+        m_in_begin = true;
+        return false;
+    }
+    if(m_in_begin &&
+       !IsStatement(sql_statement, sql_statement_size, "COMMIT") &&
+       !IsStatement(sql_statement, sql_statement_size, "ROLLBACK")) return false;
+    m_in_begin = false;
+    return true;
+}
+
+bool TransactionTracker::IsStatement(const char* sql_statement, int sql_statement_size, const char* keyword) {
+    const int keyword_size = strlen(keyword);
+    return sql_statement && sql_statement_size == keyword_size && memcmp(sql_statement, keyword, keyword_size) == 0;
+}
+
+//******************************
+// ROW IMAGE SCANNER CLASS
+//******************************
+
+RowScanner::RowScanner():
+    m_data(NULL), m_data_size(0), m_is_update(false), m_meta(NULL),
+    m_table_id(0), m_num_of_columns(0), m_pos(0), m_row_pos(0), m_row_size(0), m_after_image(true)
+{
+}
+
+RowScanner::RowScanner(const char* data, int data_size, const MetaMap& meta_map, bool is_update) {
+    reset(data, data_size, meta_map, is_update);
+}
+
+void RowScanner::reset(const char* data, int data_size, const MetaMap& meta_map, bool is_update) {
+    m_data = data;
+    m_data_size = data_size;
+    m_is_update = is_update;
+    m_meta = NULL;
+    m_table_id = 0;
+    m_num_of_columns = 0;
+    m_pos = 0;
+    m_row_pos = 0;
+    m_row_size = 0;
+    m_after_image = true;
+
+    const int POST_HEADER_BYTE_SIZE = 8;
+    if(data_size <= POST_HEADER_BYTE_SIZE) return;
+
+    m_table_id = Event::ReadTableId(data);
+    MetaMap::const_iterator it = meta_map.find(m_table_id);
+    if(it == meta_map.end()) return;
+
+    int pos = POST_HEADER_BYTE_SIZE;
+    m_num_of_columns = unpack_packed_integer(data + pos);
+    pos += packed_integer_size(data + pos);
+    if(m_num_of_columns > static_cast<int>(it->second.first.size())) return;
+
+    const int mask_byte_size = (m_num_of_columns + 7) / 8;
+    if(pos + mask_byte_size * (is_update ? 2 : 1) > data_size) return;
+
+    m_used_column.resize(m_num_of_columns);
+    for(int i = 0; i < m_num_of_columns; ++i)
+        m_used_column[i] = (data[pos + i / 8] >> (i % 8)) & 1;
+    pos += mask_byte_size;
+
+    if(is_update) {
+        m_used_column_after.resize(m_num_of_columns);
+        for(int i = 0; i < m_num_of_columns; ++i)
+            m_used_column_after[i] = (data[pos + i / 8] >> (i % 8)) & 1;
+        pos += mask_byte_size;
+    }
+
+    m_null_column.resize(m_num_of_columns);
+    m_column_pos.resize(m_num_of_columns);
+    m_column_size.resize(m_num_of_columns);
+
+    m_pos = pos;
+    m_meta = &it->second;
+}
+
+bool RowScanner::isUsed(int column_index) const {
+    if(m_is_update && m_after_image) return m_used_column_after[column_index];
+    return m_used_column[column_index];
+}
+
+bool RowScanner::next() {
+    if(!m_meta || m_pos >= m_data_size) return false;
+
+    m_after_image = m_is_update && !m_after_image;
+
+    int pos = m_pos;
+
+    int num_of_used_columns = 0;
+    for(int i = 0; i < m_num_of_columns; ++i)
+        if(isUsed(i)) ++num_of_used_columns;
+
+    const int mask_byte_size = (num_of_used_columns + 7) / 8;
+    if(pos + mask_byte_size > m_data_size) return false;
+
+    for(int i = 0, bit = 0; i < m_num_of_columns; ++i) {
+        m_null_column[i] = false;
+        if(!isUsed(i)) continue;
+        m_null_column[i] = (m_data[pos + bit / 8] >> (bit % 8)) & 1;
+        ++bit;
+    }
+    pos += mask_byte_size;
+
+    for(int i = 0; i < m_num_of_columns; ++i) {
+        m_column_pos[i] = pos;
+        m_column_size[i] = 0;
+        if(!isUsed(i) || m_null_column[i]) continue;
+        const int csize = Event::GetColumnImageSize(getColumnType(i), getMetadata(i), m_data + pos);
+        if(pos + csize > m_data_size) {
+            cerr << "row image exceeds event data" << endl;
+            return false;
+        }
+        m_column_size[i] = csize;
+        pos += csize;
+    }
 
+    m_row_pos = m_pos;
+    m_row_size = pos - m_pos;
+    m_pos = pos;
     return true;
 }
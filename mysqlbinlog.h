@@ -1,6 +1,7 @@
 #ifndef MYSQLBINLOG_H_201506132102
 #define MYSQLBINLOG_H_201506132102
 
+#include "gtid.h"
 #include <fstream>
 #include <string>
 #include <map>
@@ -17,8 +18,19 @@ enum TypeCode {
     WRITE_ROWS_EVENT=23,
     UPDATE_ROWS_EVENT=24,
     DELETE_ROWS_EVENT=25,
+    HEARTBEAT_LOG_EVENT=27,
+    WRITE_ROWS_EVENT_V2=30,
+    UPDATE_ROWS_EVENT_V2=31,
+    DELETE_ROWS_EVENT_V2=32,
+    GTID_LOG_EVENT=33,
+    ANONYMOUS_GTID_LOG_EVENT=34,
+    PREVIOUS_GTIDS_LOG_EVENT=35,
 };
 
+// set on a QUERY_EVENT that is not to run in its default database, such
+// as CREATE DATABASE and DROP DATABASE
+const int LOG_EVENT_SUPPRESS_USE_F = 0x8;
+
 enum ColumnType {
     MYSQL_TYPE_DECIMAL, MYSQL_TYPE_TINY,
     MYSQL_TYPE_SHORT, MYSQL_TYPE_LONG,
@@ -44,10 +56,12 @@ enum ColumnType {
     MYSQL_TYPE_GEOMETRY=255,
 };
 
+// table ids are 6 bytes in the binlog and grow for as long as the server runs
+typedef long long unsigned int TableId;
 typedef std::pair<std::string,std::string> pss;
-typedef std::map<int,pss> TableMap;
+typedef std::map<TableId,pss> TableMap;
 typedef std::pair<std::vector<ColumnType>,std::vector<int> > pvv;
-typedef std::map<int,pvv> MetaMap;
+typedef std::map<TableId,pvv> MetaMap;
 typedef std::vector<std::string> RowImg;
 
 class Event {
@@ -67,22 +81,44 @@ class Event {
  public:
     std::string getDBName() const;
     std::string getSQLStatement() const;
+    static const char* ReadSQLStatement(const char* data, int data_size, int& sql_statement_size);
 
  public:
     std::string getNextBinlogName() const;
 
  public:
-    int getTableId() const {
+    std::string getGtidSid() const {
+        return m_gtid_sid;
+    };
+    long long getGtidGno() const {
+        return m_gtid_gno;
+    };
+    const GtidSet& getPreviousGtids() const {
+        return m_previous_gtids;
+    };
+
+ public:
+    TableId getTableId() const {
         return m_table_id;
     };
     int getNumOfColumns() const {
         return m_num_of_columns;
     };
     std::string getTableName() const;
+    void storeTableMap(TableMap& table_map, MetaMap& meta_map) const;
+    static TableId ReadTableId(const char* data);
 
  public:
     ColumnType getColumnType(int column_index) const;
     int getMetadata(int column_index) const;
+    // empty unless the server logs them (binlog_row_metadata=FULL)
+    const std::vector<std::string>& getColumnNames() const {
+        return m_column_names;
+    };
+    bool isUnsigned(int column_index) const {
+        return column_index < static_cast<int>(m_unsigned_columns.size()) && m_unsigned_columns[column_index];
+    };
+    static int GetLengthPrefixSize(ColumnType ctype, unsigned int meta);
 
  public:
     const std::vector<RowImg>& getRows() const {
@@ -92,7 +128,10 @@ class Event {
  private:
     bool parseQueryEventData();
     bool parseRotateEventData();
+    bool parseGtidEventData();
+    bool parsePreviousGtidsEventData();
     bool parseTableMapEventData();
+    void parseOptionalMetadata(int pos, int num_of_columns, const ColumnType* column_types);
     bool parseWriteRowsEventData(const TableMap& table_map, const MetaMap& meta_map);
     bool parseUpdateRowsEventData(const TableMap& table_map, const MetaMap& meta_map);
     bool parseDeleteRowsEventData(const TableMap& table_map, const MetaMap& meta_map);
@@ -117,19 +156,164 @@ class Event {
     int m_next_binlog_name_size;
 
  private:
-    int m_table_id;
+    std::string m_gtid_sid;
+    long long m_gtid_gno;
+    GtidSet m_previous_gtids;
+
+ private:
+    TableId m_table_id;
     char* m_table_name;
     int m_table_name_size;
     ColumnType* m_column_types;
     int m_num_of_columns;
     char* m_metadata_block;
     int m_metadata_block_size;
+    std::vector<char> m_unsigned_columns;
+    std::vector<std::string> m_column_names;
 
  private:
     static int GetColumnImageSize(ColumnType ctype, unsigned int meta, const char* data);
 
  private:
     std::vector<RowImg> m_rows;
+
+ private:
+    friend class RowScanner;
+};
+
+// Walks the row images of a WRITE/UPDATE/DELETE_ROWS_EVENT body in place.
+// Column values are located but never formatted, so callers that only count,
+// hash or compare rows do not pay for string conversion.
+class RowScanner {
+ public:
+    RowScanner();
+    RowScanner(const char* data, int data_size, const MetaMap& meta_map, bool is_update = false);
+
+ public:
+    // Points the scanner at another rows event body. The column buffers keep
+    // their capacity, so a scanner reused across events allocates only once.
+    void reset(const char* data, int data_size, const MetaMap& meta_map, bool is_update = false);
+    bool isValid() const {
+        return m_meta != NULL;
+    };
+    bool next();
+
+ public:
+    TableId getTableId() const {
+        return m_table_id;
+    };
+    int getNumOfColumns() const {
+        return m_num_of_columns;
+    };
+    bool isAfterImage() const {
+        return m_after_image;
+    };
+    const char* getRowData() const {
+        return m_data + m_row_pos;
+    };
+    int getRowSize() const {
+        return m_row_size;
+    };
+
+ public:
+    bool isUsed(int column_index) const;
+    bool isNull(int column_index) const {
+        return m_null_column[column_index];
+    };
+    ColumnType getColumnType(int column_index) const {
+        return m_meta->first[column_index];
+    };
+    unsigned int getMetadata(int column_index) const {
+        return static_cast<unsigned int>(m_meta->second[column_index]);
+    };
+    const char* getColumnData(int column_index) const {
+        return m_data + m_column_pos[column_index];
+    };
+    int getColumnSize(int column_index) const {
+        return m_column_size[column_index];
+    };
+
+ private:
+    const char* m_data;
+    int m_data_size;
+    bool m_is_update;
+    const pvv* m_meta;
+
+ private:
+    TableId m_table_id;
+    int m_num_of_columns;
+    std::vector<char> m_used_column;
+    std::vector<char> m_used_column_after;
+    std::vector<char> m_null_column;
+    std::vector<int> m_column_pos;
+    std::vector<int> m_column_size;
+
+ private:
+    int m_pos;
+    int m_row_pos;
+    int m_row_size;
+    bool m_after_image;
+};
+
+class MySQLBinlog;
+
+// The table and column maps of the TABLE_MAP_EVENTs read so far. Every
+// transaction repeats the TABLE_MAP_EVENTs of the tables it changes, so
+// one is decoded only when it differs from the last one of its table id.
+class TableMapCache {
+ public:
+    TableMapCache();
+    ~TableMapCache();
+
+ public:
+    bool store(const MySQLBinlog& parser);
+    // the TABLE_MAP_EVENT last decoded by store()
+    const Event* getEvent() const {
+        return m_event;
+    };
+    const TableMap& getTableMap() const {
+        return m_table_map;
+    };
+    const MetaMap& getMetaMap() const {
+        return m_meta_map;
+    };
+
+ private:
+    TableMapCache(const TableMapCache&);
+    TableMapCache& operator=(const TableMapCache&);
+
+ private:
+    TableMap m_table_map;
+    MetaMap m_meta_map;
+    std::map<TableId,std::string> m_data;
+    Event* m_event;
+};
+
+// Follows where transactions end as the events of a binlog go by: at
+// XID_EVENT, or at the COMMIT or ROLLBACK of a transaction opened by BEGIN.
+// Outside BEGIN a QUERY_EVENT, such as DDL, is a transaction of its own.
+// Only QUERY_EVENT needs its body passed.
+class TransactionTracker {
+ public:
+    TransactionTracker(): m_in_begin(false) {}
+
+ public:
+    bool endsTransaction(TypeCode type, const char* data, int data_size);
+
+ private:
+    static bool IsStatement(const char* sql_statement, int sql_statement_size, const char* keyword);
+
+ private:
+    bool m_in_begin;
+};
+
+// Supplies whole events (common header included) from somewhere other than
+// a binlog file, e.g. a replication connection. The returned buffer must
+// stay valid until the next call.
+class EventSource {
+ public:
+    virtual ~EventSource() {}
+    virtual bool next(const char*& event, int& event_size) = 0;
 };
 
 class MySQLBinlog {
@@ -139,20 +323,51 @@ class MySQLBinlog {
 
  public:
     bool open(const char* src);
+    bool open(EventSource* source);
     bool read();
+    bool readEventHeader();
+    bool readEventData();
     Event* getEvent(const TableMap& table_map, const MetaMap& meta_map);
     bool close();
 
+ public:
+    const char* getData() const {
+        return m_data;
+    };
+    int getDataSize() const {
+        return m_data_size;
+    };
+
  public:
     std::string getServerVersion() const;
     int getServerId() const;
 
+ public:
+    TypeCode getTypeCode() const;
+    int getTimestamp() const;
+    int getEventLength() const;
+    int getPosition() const;
+    int getNextPosition() const;
+    int getFlags() const;
+    void setNextPosition(int position);
+
+ public:
+    // servers from 5.6.1 on can checksum events
+    static bool HasChecksumAlgorithm(const char* server_version);
+
  private:
     bool checkBinlog();
 
  private:
     bool readHeader();
     bool readData(TypeCode type);
+    bool dropRowsExtraData();
+    bool readBytes(char* dst, int byte_size);
+    bool skipBytes(int byte_size);
+    void seek(int position);
+
+ private:
+    static TypeCode ToRowsEventV1(TypeCode type);
 
  private:
     char* m_timestamp_bytes;
@@ -160,6 +375,7 @@ class MySQLBinlog {
     char* m_server_id_bytes;
     char* m_event_length_bytes;
     char* m_next_position_bytes;
+    char* m_flags_bytes;
 
  private:
     char* m_binlog_format_version_bytes;
@@ -168,6 +384,16 @@ class MySQLBinlog {
 
  private:
     std::fstream m_src;
+    int m_position;
+
+ private:
+    EventSource* m_source;
+    const char* m_event;
+    int m_event_size;
+    int m_event_pos;
+
+ private:
+    int m_checksum_alg;
 
  private:
     static const int TIMESTAMP_BYTE_SIZE = 4;
@@ -181,10 +407,43 @@ class MySQLBinlog {
     static const int BINLOG_FORMAT_VERSION_BYTE_SIZE = 2;
     static const int SERVER_VERSION_BYTE_SIZE = 50;
     static const int HEADER_LENGTH_BYTE_SIZE = 1;
+    static const int CHECKSUM_ALG_BYTE_SIZE = 1;
+    static const int CHECKSUM_BYTE_SIZE = 4;
+
+ private:
+    static const int BINLOG_CHECKSUM_ALG_OFF = 0;
+    static const int BINLOG_CHECKSUM_ALG_CRC32 = 1;
+    static const int LOG_EVENT_ARTIFICIAL_F = 0x20;
 
  private:
     char* m_data;
     int m_data_size;
+    int m_data_capacity;
+};
+
+// Reads a binlog file for its row events, keeping its table maps on the
+// way. next() stops at every rows event, whose body is then in getParser(),
+// and at every TABLE_MAP_EVENT that changed the maps.
+class RowEventReader {
+ public:
+    bool open(const char* src_file);
+    bool next();
+    bool close();
+
+ public:
+    TypeCode getTypeCode() const {
+        return m_parser.getTypeCode();
+    };
+    MySQLBinlog& getParser() {
+        return m_parser;
+    };
+    const TableMapCache& getTableMaps() const {
+        return m_table_maps;
+    };
+
+ private:
+    MySQLBinlog m_parser;
+    TableMapCache m_table_maps;
 };
 
 #endif // #ifndef MYSQLBINLOG_H_201506132102
@@ -0,0 +1,214 @@
+#include "sampler.h"
+#include "binlogstream.h"
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+namespace {
+
+const char* eventTypeName(int type) {
+    switch(type) {
+        case QUERY_EVENT: return "QUERY_EVENT";
+        case STOP_EVENT: return "STOP_EVENT";
+        case ROTATE_EVENT: return "ROTATE_EVENT";
+        case FORMAT_DESCRIPTION_EVENT: return "FORMAT_DESCRIPTION_EVENT";
+        case XID_EVENT: return "XID_EVENT";
+        case TABLE_MAP_EVENT: return "TABLE_MAP_EVENT";
+        case WRITE_ROWS_EVENT: return "WRITE_ROWS_EVENT";
+        case UPDATE_ROWS_EVENT: return "UPDATE_ROWS_EVENT";
+        case DELETE_ROWS_EVENT: return "DELETE_ROWS_EVENT";
+        case WRITE_ROWS_EVENT_V2: return "WRITE_ROWS_EVENT_V2";
+        case UPDATE_ROWS_EVENT_V2: return "UPDATE_ROWS_EVENT_V2";
+        case DELETE_ROWS_EVENT_V2: return "DELETE_ROWS_EVENT_V2";
+        case GTID_LOG_EVENT: return "GTID_LOG_EVENT";
+        case ANONYMOUS_GTID_LOG_EVENT: return "ANONYMOUS_GTID_LOG_EVENT";
+        case PREVIOUS_GTIDS_LOG_EVENT: return "PREVIOUS_GTIDS_LOG_EVENT";
+        default: return NULL;
+    }
+}
+
+const char* const STATISTIC_NAMES[] = {
+    "write_rows", "update_rows", "delete_rows", "row_bytes"
+};
+
+// Counts the events of a source as they are handed to MySQLBinlog, which
+// keeps FORMAT_DESCRIPTION_EVENTs to itself, by their type code as logged.
+class CountingSource: public EventSource {
+ public:
+    CountingSource(EventSource& source, map<int, pair<long long, long long> >& event_types):
+        m_source(source), m_event_types(event_types) {}
+
+    virtual bool next(const char*& event, int& event_size) {
+        const int TYPE_CODE_OFFSET = 4;
+        if(!m_source.next(event, event_size)) return false;
+        if(event_size > TYPE_CODE_OFFSET) {
+            pair<long long, long long>& event_type = m_event_types[static_cast<unsigned char>(event[TYPE_CODE_OFFSET])];
+            ++event_type.first;
+            event_type.second += event_size;
+        }
+        return true;
+    }
+
+ private:
+    EventSource& m_source;
+    map<int, pair<long long, long long> >& m_event_types;
+};
+
+}
+
+//******************************
+// TRANSACTION SAMPLER CLASS
+//******************************
+
+Sampler::Sums::Sums() {
+    for(int i = 0; i < NUM_OF_STATISTICS; ++i) {
+        sum[i] = 0;
+        sum_of_squares[i] = 0;
+    }
+}
+
+Sampler::Sampler(double rate):
+    m_rate(rate), m_random(0x9E3779B97F4A7C15ULL), m_num_of_transactions(0), m_num_of_sampled(0)
+{
+}
+
+// xorshift64*; a fixed seed makes runs repeatable
+bool Sampler::sample() {
+    m_random ^= m_random >> 12;
+    m_random ^= m_random << 25;
+    m_random ^= m_random >> 27;
+    const unsigned long long r = m_random * 2685821657736338717ULL;
+    return (r >> 11) * (1.0 / 9007199254740992.0) < m_rate;
+}
+
+// A transaction starts at a GTID event, or at the first event after the
+// previous one ended, and ends where TransactionTracker says. Only
+// QUERY_EVENT bodies are read outside the sample, to tell BEGIN and COMMIT
+// from the statements in between.
+bool Sampler::scan(const vector<const char*>& src_files) {
+    BinlogStream stream(src_files);
+    CountingSource source(stream, m_event_types);
+    MySQLBinlog parser;
+    if(!stream.open() || !parser.open(&source)) {
+        cerr << "file open failed " << src_files[0] << endl;
+        return false;
+    }
+
+    TableMapCache table_maps;
+    TransactionCounts counts;
+    TransactionTracker transactions;
+    bool in_transaction = false;
+    bool sampled = false;
+
+    while(parser.readEventHeader()) {
+        const TypeCode type = parser.getTypeCode();
+
+        if(PREVIOUS_GTIDS_LOG_EVENT == type) continue;
+
+        if(ROTATE_EVENT == type || STOP_EVENT == type) {
+            // a transaction cut off by the end of a file is over too
+            transactions.endsTransaction(type, NULL, 0);
+            if(in_transaction && sampled) endTransaction(counts, table_maps.getTableMap());
+            in_transaction = false;
+            continue;
+        }
+
+        if(!in_transaction || GTID_LOG_EVENT == type || ANONYMOUS_GTID_LOG_EVENT == type) {
+            if(in_transaction && sampled) endTransaction(counts, table_maps.getTableMap());
+            in_transaction = true;
+            sampled = sample();
+            ++m_num_of_transactions;
+            if(sampled) ++m_num_of_sampled;
+        }
+
+        if(QUERY_EVENT == type) {
+            if(!parser.readEventData()) break;
+        }
+
+        else if(sampled && TABLE_MAP_EVENT == type) {
+            if(!parser.readEventData()) break;
+            table_maps.store(parser);
+        }
+
+        else if(sampled &&
+                (WRITE_ROWS_EVENT == type ||
+                 UPDATE_ROWS_EVENT == type ||
+                 DELETE_ROWS_EVENT == type)) {
+            if(!parser.readEventData()) break;
+            RowScanner scanner(parser.getData(), parser.getDataSize(), table_maps.getMetaMap(), UPDATE_ROWS_EVENT == type);
+            if(scanner.isValid()) {
+                vector<long long>& table_counts = counts[scanner.getTableId()];
+                table_counts.resize(NUM_OF_STATISTICS);
+                int num_of_images = 0;
+                while(scanner.next()) {
+                    ++num_of_images;
+                    table_counts[ROW_BYTES] += scanner.getRowSize();
+                }
+                const Statistic rows = WRITE_ROWS_EVENT == type ? WRITE_ROWS :
+                                       UPDATE_ROWS_EVENT == type ? UPDATE_ROWS : DELETE_ROWS;
+                table_counts[rows] += UPDATE_ROWS_EVENT == type ? num_of_images / 2 : num_of_images;
+            }
+        }
+
+        if(transactions.endsTransaction(type, parser.getData(), parser.getDataSize())) {
+            if(sampled) endTransaction(counts, table_maps.getTableMap());
+            in_transaction = false;
+        }
+    }
+
+    if(in_transaction && sampled) endTransaction(counts, table_maps.getTableMap());
+
+    parser.close();
+    stream.close();
+    return true;
+}
+
+void Sampler::endTransaction(TransactionCounts& counts, const TableMap& table_map) {
+    for(TransactionCounts::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        TableMap::const_iterator tit = table_map.find(it->first);
+        if(tit == table_map.end()) continue;
+        Sums& sums = m_tables[tit->second];
+        for(int i = 0; i < NUM_OF_STATISTICS; ++i) {
+            const double x = it->second[i];
+            sums.sum[i] += x;
+            sums.sum_of_squares[i] += x * x;
+        }
+    }
+    counts.clear();
+}
+
+// A table's total is the number of transactions times its mean per sampled
+// transaction. The error is 1.96 standard errors of that estimate, with
+// the finite population correction, as the transactions are all counted.
+// It is unknown, "-", with fewer than two transactions sampled, and when
+// no sampled transaction had any of the statistic: a sample of zeros has
+// no spread to bound, however many of the rest are not zero.
+void Sampler::print(ostream& out) const {
+    out << "# " << m_num_of_sampled << " of " << m_num_of_transactions << " transactions sampled" << '\n';
+    out << "scope\tname\tstatistic\testimate\terror" << '\n';
+
+    for(map<int, pair<long long, long long> >::const_iterator it = m_event_types.begin(); it != m_event_types.end(); ++it) {
+        const char* name = eventTypeName(it->first);
+        const string type_name = name ? string(name) : "EVENT_" + to_string(it->first);
+        out << "event_type" << '\t' << type_name << '\t' << "events" << '\t' << it->second.first << '\t' << 0 << '\n'
+            << "event_type" << '\t' << type_name << '\t' << "bytes" << '\t' << it->second.second << '\t' << 0 << '\n';
+    }
+
+    const double n = m_num_of_sampled;
+    const double total = m_num_of_transactions;
+    for(map<pss, Sums>::const_iterator it = m_tables.begin(); it != m_tables.end(); ++it) {
+        for(int i = 0; i < NUM_OF_STATISTICS; ++i) {
+            const double mean = it->second.sum[i] / n;
+            out << "table" << '\t' << it->first.first << '.' << it->first.second << '\t'
+                << STATISTIC_NAMES[i] << '\t' << llround(total * mean) << '\t';
+            if(n < 2 || (it->second.sum[i] == 0 && n < total)) {
+                out << '-' << '\n';
+                continue;
+            }
+            const double variance = max(0.0, (it->second.sum_of_squares[i] - n * mean * mean) / (n - 1));
+            out << llround(1.96 * total * sqrt((1 - n / total) * variance / n)) << '\n';
+        }
+    }
+    out << flush;
+}
@@ -0,0 +1,50 @@
+#ifndef SAMPLER_H_202610192300
+#define SAMPLER_H_202610192300
+
+#include "mysqlbinlog.h"
+#include <ostream>
+#include <map>
+#include <vector>
+
+// Approximate write mix of large archives. Every event header is read, so
+// events and bytes per event type are counted exactly, but only a random
+// sample of whole transactions has its bodies read and its rows walked.
+// Per-table totals are extrapolated from the sample with a 95% error bound.
+// The files are read as one BinlogStream, so a transaction may span them.
+class Sampler {
+ public:
+    explicit Sampler(double rate);
+
+ public:
+    bool scan(const std::vector<const char*>& src_files);
+    void print(std::ostream& out) const;
+
+ private:
+    enum Statistic {
+        WRITE_ROWS, UPDATE_ROWS, DELETE_ROWS, ROW_BYTES, NUM_OF_STATISTICS
+    };
+
+    // sums over the sampled transactions of one table's values in each
+    struct Sums {
+        Sums();
+        double sum[NUM_OF_STATISTICS];
+        double sum_of_squares[NUM_OF_STATISTICS];
+    };
+    typedef std::map<TableId, std::vector<long long> > TransactionCounts;
+
+ private:
+    bool sample();
+    void endTransaction(TransactionCounts& counts, const TableMap& table_map);
+
+ private:
+    const double m_rate;
+    unsigned long long m_random;
+
+ private:
+    long long m_num_of_transactions;
+    long long m_num_of_sampled;
+    std::map<int, std::pair<long long, long long> > m_event_types;
+    std::map<pss, Sums> m_tables;
+};
+
+#endif // #ifndef SAMPLER_H_202610192300
@@ -0,0 +1,275 @@
+#include "search.h"
+#include "util.h"
+#include <Poco/Thread.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+namespace {
+
+// every non-null image must occur somewhere in the event body for one of
+// its rows to match
+bool containsImages(const char* data, int data_size, const vector<string>& images) {
+    for(vector<string>::const_iterator it = images.begin(); it != images.end(); ++it)
+        if(!memmem(data, data_size, it->data(), it->size())) return false;
+    return true;
+}
+
+const char* rowsEventName(TypeCode type) {
+    if(UPDATE_ROWS_EVENT == type) return "UPDATE_ROWS_EVENT";
+    if(DELETE_ROWS_EVENT == type) return "DELETE_ROWS_EVENT";
+    return "WRITE_ROWS_EVENT";
+}
+
+}
+
+//******************************
+// ROW PREDICATE SEARCH CLASS
+//******************************
+
+Searcher::Searcher(const Predicates& predicates, int num_of_threads):
+    m_predicates(predicates), m_num_of_threads(num_of_threads > 0 ? num_of_threads : 1),
+    m_src_files(NULL), m_next_file(0)
+{
+}
+
+bool Searcher::ParsePredicate(const string& text, Predicate& predicate) {
+    const string::size_type dot = text.find('.');
+    if(dot == string::npos || dot == 0) return false;
+    const string::size_type colon = text.find(':', dot + 1);
+    if(colon == string::npos || colon == dot + 1) return false;
+    const string::size_type equal = text.find('=', colon + 1);
+    if(equal == string::npos) return false;
+
+    const string column = text.substr(colon + 1, equal - colon - 1);
+    char* endp = NULL;
+    predicate.column = static_cast<int>(strtol(column.c_str(), &endp, 10));
+    if(column.empty() || *endp != '\0' || predicate.column < 0) return false;
+
+    predicate.table = pss(text.substr(0, dot), text.substr(dot + 1, colon - dot - 1));
+    predicate.value = text.substr(equal + 1);
+    predicate.is_null = predicate.value == "null" || predicate.value == "NULL";
+    return true;
+}
+
+bool Searcher::run(const vector<const char*>& src_files, ostream& out) {
+    m_src_files = &src_files;
+    m_next_file = 0;
+    m_results.assign(src_files.size(), string());
+    m_done.assign(src_files.size(), 0);
+    m_succeeded.assign(src_files.size(), 0);
+
+    const int num_of_threads = min(m_num_of_threads, static_cast<int>(src_files.size()));
+    vector<Worker*> workers;
+    vector<Poco::Thread*> threads;
+    for(int i = 0; i < num_of_threads; ++i) {
+        workers.push_back(new Worker(*this));
+        threads.push_back(new Poco::Thread());
+        threads.back()->start(*workers.back());
+    }
+
+    // results are printed in file order as soon as each file is done
+    bool succeeded = true;
+    for(size_t i = 0; i < src_files.size(); ++i) {
+        string result;
+        {
+            Poco::Mutex::ScopedLock lock(m_mutex);
+            while(!m_done[i]) m_condition.wait(m_mutex);
+            result.swap(m_results[i]);
+            succeeded = succeeded && m_succeeded[i];
+        }
+        out << result << flush;
+    }
+
+    for(int i = 0; i < num_of_threads; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        delete workers[i];
+    }
+    m_src_files = NULL;
+    return succeeded;
+}
+
+bool Searcher::scan(const char* src_file, string& out) const {
+    RowEventReader reader;
+    if(!reader.open(src_file)) return false;
+    MySQLBinlog& parser = reader.getParser();
+    const TableMap& table_map = reader.getTableMaps().getTableMap();
+    const MetaMap& meta_map = reader.getTableMaps().getMetaMap();
+
+    map<TableId,ColumnTests> searched_tables;
+    stringstream lines;
+
+    while(reader.next()) {
+        const TypeCode type = reader.getTypeCode();
+
+        if(TABLE_MAP_EVENT == type) {
+            const Event* event = reader.getTableMaps().getEvent();
+            ColumnTests tests;
+            if(compile(event, tests)) searched_tables[event->getTableId()].swap(tests);
+            else searched_tables.erase(event->getTableId());
+            continue;
+        }
+
+        const char* data = parser.getData();
+        const int data_size = parser.getDataSize();
+        map<TableId,ColumnTests>::const_iterator sit = searched_tables.find(Event::ReadTableId(data));
+        if(sit == searched_tables.end()) continue;
+
+        const ColumnTests& tests = sit->second;
+        vector<string> images;
+        for(ColumnTests::const_iterator it = tests.begin(); it != tests.end(); ++it)
+            if(!it->is_null) images.push_back(it->image);
+        if(!containsImages(data, data_size, images)) continue;
+
+        RowScanner scanner(data, data_size, meta_map, UPDATE_ROWS_EVENT == type);
+        if(!scanner.isValid()) continue;
+        vector<char> matched;
+        bool any_matched = false;
+        while(scanner.next()) {
+            matched.push_back(Matches(scanner, tests));
+            any_matched = any_matched || matched.back();
+        }
+        if(!any_matched) continue;
+
+        const Event* event = parser.getEvent(table_map, meta_map);
+        const pss& table = table_map.at(event->getTableId());
+        const vector<RowImg>& rows = event->getRows();
+        const size_t step = UPDATE_ROWS_EVENT == type ? 2 : 1;
+        for(size_t i = 0; i + step <= rows.size() && i + step <= matched.size(); i += step) {
+            if(!matched[i] && !matched[i + step - 1]) continue;
+            lines << src_file << '\t'
+                  << parser.getPosition() << '\t'
+                  << formatTimestamp(event->getTimestamp()) << " UTC" << '\t'
+                  << rowsEventName(type) << '\t'
+                  << table.first << '\t' << table.second << '\t';
+            printRowImg(lines, rows[i]);
+            if(UPDATE_ROWS_EVENT == type) {
+                lines << " => ";
+                printRowImg(lines, rows[i + 1]);
+            }
+            lines << '\n';
+        }
+        delete event;
+    }
+
+    reader.close();
+    out = lines.str();
+    return true;
+}
+
+// Returns false when the table is not searched or a predicate on it can
+// never match.
+bool Searcher::compile(const Event* event, ColumnTests& tests) const {
+    const pss table(event->getDBName(), event->getTableName());
+    tests.clear();
+    for(Predicates::const_iterator it = m_predicates.begin(); it != m_predicates.end(); ++it) {
+        if(it->table != table) continue;
+        if(it->column >= event->getNumOfColumns()) {
+            cerr << table.first << '.' << table.second << " has no column " << it->column << endl;
+            return false;
+        }
+        ColumnTest test;
+        test.column = it->column;
+        test.is_null = it->is_null;
+        test.offset = 0;
+        if(!it->is_null && !EncodeColumnImage(event->getColumnType(it->column),
+                                              event->getMetadata(it->column), it->value, test)) {
+            cerr << "cannot compare column " << it->column << " of " << table.first << '.' << table.second
+                 << " with " << it->value << endl;
+            return false;
+        }
+        tests.push_back(test);
+    }
+    return !tests.empty();
+}
+
+bool Searcher::Matches(const RowScanner& scanner, const ColumnTests& tests) {
+    for(ColumnTests::const_iterator it = tests.begin(); it != tests.end(); ++it) {
+        if(it->column >= scanner.getNumOfColumns() || !scanner.isUsed(it->column)) return false;
+        if(scanner.isNull(it->column) != it->is_null) return false;
+        if(it->is_null) continue;
+        if(scanner.getColumnSize(it->column) != it->offset + static_cast<int>(it->image.size())) return false;
+        if(memcmp(scanner.getColumnData(it->column) + it->offset, it->image.data(), it->image.size()) != 0) return false;
+    }
+    return true;
+}
+
+// Builds the row image a column of the given type holds for value: the
+// little-endian bytes of an integer, or the bytes of a string after its
+// length prefix. Other types are not searchable.
+bool Searcher::EncodeColumnImage(ColumnType ctype, unsigned int meta, const string& value, ColumnTest& test) {
+    int byte_size = 0;
+    switch(ctype) {
+        case MYSQL_TYPE_TINY: byte_size = 1; break;
+        case MYSQL_TYPE_SHORT: byte_size = 2; break;
+        case MYSQL_TYPE_INT24: byte_size = 3; break;
+        case MYSQL_TYPE_LONG: byte_size = 4; break;
+        case MYSQL_TYPE_LONGLONG: byte_size = 8; break;
+        default: break;
+    }
+
+    if(byte_size > 0) {
+        if(value.empty()) return false;
+        char* endp = NULL;
+        errno = 0;
+        unsigned long long bits;
+        if(value[0] == '-') {
+            const long long n = strtoll(value.c_str(), &endp, 10);
+            if(byte_size < 8 && n < -(1LL << (8 * byte_size - 1))) return false;
+            bits = static_cast<unsigned long long>(n);
+        }
+        else {
+            bits = strtoull(value.c_str(), &endp, 10);
+            if(byte_size < 8 && bits >= (1ULL << (8 * byte_size))) return false;
+        }
+        if(*endp != '\0' || errno != 0) return false;
+        test.offset = 0;
+        test.image.clear();
+        for(int i = 0; i < byte_size; ++i) test.image += static_cast<char>((bits >> (8 * i)) & 0xFF);
+        return true;
+    }
+
+    if(MYSQL_TYPE_STRING == ctype && ((meta >> 8) == MYSQL_TYPE_ENUM || (meta >> 8) == MYSQL_TYPE_SET)) return false;
+
+    if(MYSQL_TYPE_VARCHAR == ctype || MYSQL_TYPE_VAR_STRING == ctype || MYSQL_TYPE_STRING == ctype) {
+        test.offset = Event::GetLengthPrefixSize(ctype, meta);
+        test.image = value;
+        return true;
+    }
+
+    return false;
+}
+
+//******************************
+// SEARCH WORKER THREAD CLASS
+//******************************
+
+Searcher::Worker::Worker(Searcher& searcher):
+    m_searcher(searcher)
+{
+}
+
+void Searcher::Worker::run() {
+    for(;;) {
+        size_t i;
+        {
+            Poco::Mutex::ScopedLock lock(m_searcher.m_mutex);
+            if(m_searcher.m_next_file >= m_searcher.m_src_files->size()) break;
+            i = m_searcher.m_next_file++;
+        }
+
+        string result;
+        const bool succeeded = m_searcher.scan((*m_searcher.m_src_files)[i], result);
+
+        Poco::Mutex::ScopedLock lock(m_searcher.m_mutex);
+        m_searcher.m_results[i].swap(result);
+        m_searcher.m_succeeded[i] = succeeded;
+        m_searcher.m_done[i] = 1;
+        m_searcher.m_condition.broadcast();
+    }
+}
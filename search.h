@@ -0,0 +1,78 @@
+#ifndef SEARCH_H_202610192000
+#define SEARCH_H_202610192000
+
+#include "mysqlbinlog.h"
+#include <Poco/Condition.h>
+#include <Poco/Mutex.h>
+#include <Poco/Runnable.h>
+#include <ostream>
+#include <string>
+#include <map>
+#include <vector>
+
+// Column predicate "db.table:COL=VALUE"; VALUE null matches SQL NULL.
+struct Predicate {
+    pss table;
+    int column;
+    bool is_null;
+    std::string value;
+};
+typedef std::vector<Predicate> Predicates;
+
+// Finds the row events in which some row image satisfies every predicate
+// given for its table. Predicates are compiled into the raw column image
+// once per TABLE_MAP_EVENT and compared in place; an event whose body does
+// not contain every image at all is rejected without walking its rows, and
+// only matching events are decoded to text. Files are scanned by a pool of
+// threads and reported in the order they were given.
+class Searcher {
+ public:
+    Searcher(const Predicates& predicates, int num_of_threads);
+
+ public:
+    bool run(const std::vector<const char*>& src_files, std::ostream& out);
+
+ public:
+    static bool ParsePredicate(const std::string& text, Predicate& predicate);
+
+ private:
+    // the column matches when its image is image preceded by offset bytes
+    // of length prefix
+    struct ColumnTest {
+        int column;
+        bool is_null;
+        int offset;
+        std::string image;
+    };
+    typedef std::vector<ColumnTest> ColumnTests;
+
+    class Worker: public Poco::Runnable {
+     public:
+        explicit Worker(Searcher& searcher);
+        virtual void run();
+
+     private:
+        Searcher& m_searcher;
+    };
+
+ private:
+    bool scan(const char* src_file, std::string& out) const;
+    bool compile(const Event* event, ColumnTests& tests) const;
+    static bool Matches(const RowScanner& scanner, const ColumnTests& tests);
+    static bool EncodeColumnImage(ColumnType ctype, unsigned int meta, const std::string& value, ColumnTest& test);
+
+ private:
+    const Predicates m_predicates;
+    const int m_num_of_threads;
+
+ private:
+    Poco::Mutex m_mutex;
+    Poco::Condition m_condition;
+    const std::vector<const char*>* m_src_files;
+    size_t m_next_file;
+    std::vector<std::string> m_results;
+    std::vector<char> m_done;
+    std::vector<char> m_succeeded;
+};
+
+#endif // #ifndef SEARCH_H_202610192000
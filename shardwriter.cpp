@@ -0,0 +1,294 @@
+#include "shardwriter.h"
+#include "util.h"
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+using namespace std;
+
+namespace {
+
+// FNV-1a over the raw column image, so equal values land in one partition
+// whatever their type.
+unsigned int hashBytes(const char* data, int size) {
+    unsigned int h = 2166136261U;
+    for(int i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+string safeFileName(const string& name) {
+    string safe(name);
+    for(string::iterator it = safe.begin(); it != safe.end(); ++it)
+        if(*it == '/' || *it == '\\' || *it == '\0') *it = '_';
+    return safe;
+}
+
+}
+
+//******************************
+// SHARDED OUTPUT WRITER CLASS
+//******************************
+
+ShardWriter::ShardWriter(const string& output_dir, PartitionBy partition_by, int hash_column,
+                         int num_of_partitions, int num_of_writers, int max_open_files):
+    m_output_dir(output_dir), m_partition_by(partition_by), m_hash_column(hash_column),
+    m_num_of_partitions(num_of_partitions > 0 ? num_of_partitions : 1), m_buffered_size(0)
+{
+    // every writer keeps at least one file open, so there are no more
+    // writers than open files
+    if(max_open_files < 1) max_open_files = 1;
+    if(num_of_writers < 1) num_of_writers = 1;
+    if(num_of_writers > max_open_files) num_of_writers = max_open_files;
+    const int max_open_files_per_writer = max_open_files / num_of_writers;
+    for(int i = 0; i < num_of_writers; ++i) {
+        m_writers.push_back(new Writer(max_open_files_per_writer));
+        m_threads.push_back(new Poco::Thread());
+    }
+
+    if(PARTITION_BY_HASH == m_partition_by) {
+        for(int i = 0; i < m_num_of_partitions; ++i) {
+            char name[32];
+            snprintf(name, sizeof name, "part-%04d.log", i);
+            Partition partition;
+            partition.path = Poco::Path(Poco::Path(m_output_dir).makeDirectory(), name).toString();
+            partition.writer = i % num_of_writers;
+            m_partitions.push_back(partition);
+        }
+    }
+}
+
+ShardWriter::~ShardWriter() {
+    close();
+    for(size_t i = 0; i < m_writers.size(); ++i) {
+        delete m_threads[i];
+        delete m_writers[i];
+    }
+}
+
+bool ShardWriter::ParsePartitionBy(const string& text, PartitionBy& partition_by, int& hash_column) {
+    if(text == "table") {
+        partition_by = PARTITION_BY_TABLE;
+        return true;
+    }
+    if(text.compare(0, 5, "hash(") != 0 || text[text.size() - 1] != ')') return false;
+    const string column = text.substr(5, text.size() - 6);
+    char* endp = NULL;
+    hash_column = static_cast<int>(strtol(column.c_str(), &endp, 10));
+    if(column.empty() || *endp != '\0' || hash_column < 0) return false;
+    partition_by = PARTITION_BY_HASH;
+    return true;
+}
+
+bool ShardWriter::open() {
+    try {
+        Poco::File(m_output_dir).createDirectories();
+    }
+    catch(const Poco::Exception& e) {
+        cerr << "cannot create output directory " << m_output_dir << ": " << e.displayText() << endl;
+        return false;
+    }
+    for(size_t i = 0; i < m_writers.size(); ++i) m_threads[i]->start(*m_writers[i]);
+    return true;
+}
+
+bool ShardWriter::scan(const char* src_file) {
+    RowEventReader reader;
+    if(!reader.open(src_file)) return false;
+    MySQLBinlog& parser = reader.getParser();
+    const TableMap& table_map = reader.getTableMaps().getTableMap();
+    const MetaMap& meta_map = reader.getTableMaps().getMetaMap();
+
+    while(reader.next()) {
+        const TypeCode type = reader.getTypeCode();
+        if(TABLE_MAP_EVENT == type) continue;
+
+        TableMap::const_iterator tit = table_map.find(Event::ReadTableId(parser.getData()));
+        if(tit == table_map.end()) continue;
+        const pss& table = tit->second;
+        const Event* event = parser.getEvent(table_map, meta_map);
+
+        const char* event_name = "WRITE_ROWS_EVENT";
+        if(UPDATE_ROWS_EVENT == type) event_name = "UPDATE_ROWS_EVENT";
+        else if(DELETE_ROWS_EVENT == type) event_name = "DELETE_ROWS_EVENT";
+
+        stringstream prefix;
+        prefix << formatTimestamp(event->getTimestamp()) << " UTC" << '\t'
+               << event_name << '\t' << table.first << '\t' << table.second << '\t';
+
+        const vector<RowImg>& rows = event->getRows();
+        RowScanner scanner(parser.getData(), parser.getDataSize(), meta_map, UPDATE_ROWS_EVENT == type);
+
+        for(vector<RowImg>::const_iterator it = rows.begin(); it != rows.end() && scanner.next(); ++it) {
+            stringstream line;
+            line << prefix.str();
+            printRowImg(line, *it);
+            if(UPDATE_ROWS_EVENT == type) {
+                // an update goes to the partition of its after image
+                if(++it == rows.end() || !scanner.next()) break;
+                line << " => ";
+                printRowImg(line, *it);
+            }
+            line << '\n';
+            append(partitionOf(table, scanner), line.str());
+        }
+
+        delete event;
+    }
+
+    reader.close();
+    return true;
+}
+
+int ShardWriter::partitionOf(const pss& table, const RowScanner& scanner) {
+    if(PARTITION_BY_HASH == m_partition_by) {
+        if(m_hash_column >= scanner.getNumOfColumns() ||
+           !scanner.isUsed(m_hash_column) ||
+           scanner.isNull(m_hash_column)) return 0;
+        return hashBytes(scanner.getColumnData(m_hash_column), scanner.getColumnSize(m_hash_column)) % m_num_of_partitions;
+    }
+
+    map<pss,int>::const_iterator it = m_table_partitions.find(table);
+    if(it != m_table_partitions.end()) return it->second;
+
+    Partition partition;
+    partition.path = Poco::Path(Poco::Path(m_output_dir).makeDirectory(),
+                                safeFileName(table.first + "." + table.second + ".log")).toString();
+    partition.writer = m_partitions.size() % m_writers.size();
+    m_partitions.push_back(partition);
+    m_table_partitions[table] = m_partitions.size() - 1;
+    return m_partitions.size() - 1;
+}
+
+void ShardWriter::append(int partition, const string& line) {
+    string& buffer = m_partitions[partition].buffer;
+    buffer += line;
+    m_buffered_size += line.size();
+    if(buffer.size() >= BUFFER_SIZE) flush(partition);
+    else if(m_buffered_size >= MAX_BUFFERED_SIZE) flushAll();
+}
+
+void ShardWriter::flush(int partition) {
+    Partition& p = m_partitions[partition];
+    if(p.buffer.empty()) return;
+    m_buffered_size -= p.buffer.size();
+
+    Chunk chunk;
+    chunk.partition = partition;
+    chunk.path = p.path;
+    chunk.data.swap(p.buffer);
+    p.buffer.reserve(BUFFER_SIZE);
+    m_writers[p.writer]->push(chunk);
+}
+
+void ShardWriter::flushAll() {
+    for(size_t i = 0; i < m_partitions.size(); ++i) flush(i);
+}
+
+bool ShardWriter::close() {
+    if(m_threads.empty() || !m_threads[0]->isRunning()) return true;
+
+    flushAll();
+    bool failed = false;
+    for(size_t i = 0; i < m_writers.size(); ++i) {
+        m_writers[i]->stop();
+        m_threads[i]->join();
+        failed = failed || m_writers[i]->failed();
+    }
+    return !failed;
+}
+
+//******************************
+// WRITER THREAD CLASS
+//******************************
+
+ShardWriter::Writer::Writer(int max_open_files):
+    m_max_open_files(max_open_files), m_stopped(false), m_failed(false)
+{
+}
+
+ShardWriter::Writer::~Writer() {
+    for(map<int,pair<ofstream*,list<int>::iterator> >::iterator it = m_files.begin(); it != m_files.end(); ++it)
+        delete it->second.first;
+}
+
+// Blocks while the writer is MAX_PENDING_CHUNKS behind, so a slow disk
+// throttles decoding instead of growing memory.
+void ShardWriter::Writer::push(Chunk& chunk) {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    while(m_chunks.size() >= MAX_PENDING_CHUNKS) m_condition.wait(m_mutex);
+    m_chunks.push_back(Chunk());
+    m_chunks.back().partition = chunk.partition;
+    m_chunks.back().path.swap(chunk.path);
+    m_chunks.back().data.swap(chunk.data);
+    m_condition.broadcast();
+}
+
+void ShardWriter::Writer::stop() {
+    Poco::Mutex::ScopedLock lock(m_mutex);
+    m_stopped = true;
+    m_condition.broadcast();
+}
+
+void ShardWriter::Writer::run() {
+    for(;;) {
+        Chunk chunk;
+        {
+            Poco::Mutex::ScopedLock lock(m_mutex);
+            while(m_chunks.empty() && !m_stopped) m_condition.wait(m_mutex);
+            if(m_chunks.empty()) break;
+            chunk.partition = m_chunks.front().partition;
+            chunk.path.swap(m_chunks.front().path);
+            chunk.data.swap(m_chunks.front().data);
+            m_chunks.pop_front();
+            m_condition.broadcast();
+        }
+
+        ofstream* out = file(chunk);
+        if(!out || !out->write(chunk.data.data(), chunk.data.size())) {
+            cerr << "write failed " << chunk.path << endl;
+            m_failed = true;
+        }
+    }
+
+    for(map<int,pair<ofstream*,list<int>::iterator> >::iterator it = m_files.begin(); it != m_files.end(); ++it) {
+        it->second.first->close();
+        if(it->second.first->fail()) m_failed = true;
+    }
+}
+
+// Returns the open file of a partition, evicting the least recently used
+// one when the writer is at its limit. A file is truncated the first time
+// and appended to when it is reopened after an eviction.
+ofstream* ShardWriter::Writer::file(const Chunk& chunk) {
+    map<int,pair<ofstream*,list<int>::iterator> >::iterator it = m_files.find(chunk.partition);
+    if(it != m_files.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+        return it->second.first;
+    }
+
+    if(m_files.size() >= m_max_open_files) {
+        const int victim = m_lru.back();
+        m_lru.pop_back();
+        ofstream* victim_file = m_files[victim].first;
+        victim_file->close();
+        if(victim_file->fail()) m_failed = true;
+        delete victim_file;
+        m_files.erase(victim);
+    }
+
+    const bool created = m_created[chunk.partition];
+    ofstream* out = new ofstream(chunk.path.c_str(), ios::out | ios::binary | (created ? ios::app : ios::trunc));
+    if(!out->is_open()) {
+        delete out;
+        return NULL;
+    }
+    m_created[chunk.partition] = true;
+    m_lru.push_front(chunk.partition);
+    m_files[chunk.partition] = make_pair(out, m_lru.begin());
+    return out;
+}
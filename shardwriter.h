@@ -0,0 +1,110 @@
+#ifndef SHARDWRITER_H_202610191700
+#define SHARDWRITER_H_202610191700
+
+#include "mysqlbinlog.h"
+#include <Poco/Condition.h>
+#include <Poco/Mutex.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <string>
+#include <map>
+#include <vector>
+
+// Routes decoded rows into one output file per partition, either per table
+// or by the hash of one column. Rows are appended to large per-partition
+// buffers in the decoding thread; full buffers are handed to a pool of writer
+// threads. Every partition is owned by one writer, so its buffers are written
+// in order, and each writer keeps an LRU of open files to bound descriptors.
+class ShardWriter {
+ public:
+    enum PartitionBy {
+        PARTITION_BY_TABLE, PARTITION_BY_HASH
+    };
+
+ public:
+    ShardWriter(const std::string& output_dir, PartitionBy partition_by, int hash_column,
+                int num_of_partitions, int num_of_writers, int max_open_files);
+    ~ShardWriter();
+
+ public:
+    bool open();
+    bool scan(const char* src_file);
+    bool close();
+
+ public:
+    static bool ParsePartitionBy(const std::string& text, PartitionBy& partition_by, int& hash_column);
+
+ private:
+    struct Partition {
+        std::string path;
+        std::string buffer;
+        int writer;
+    };
+
+    struct Chunk {
+        int partition;
+        std::string path;
+        std::string data;
+    };
+
+    class Writer: public Poco::Runnable {
+     public:
+        explicit Writer(int max_open_files);
+        ~Writer();
+
+     public:
+        void push(Chunk& chunk);
+        void stop();
+        bool failed() const {
+            return m_failed;
+        };
+        virtual void run();
+
+     private:
+        std::ofstream* file(const Chunk& chunk);
+
+     private:
+        static const size_t MAX_PENDING_CHUNKS = 8;
+        const size_t m_max_open_files;
+        Poco::Mutex m_mutex;
+        Poco::Condition m_condition;
+        std::deque<Chunk> m_chunks;
+        bool m_stopped;
+        bool m_failed;
+
+     private:
+        std::list<int> m_lru;
+        std::map<int,std::pair<std::ofstream*,std::list<int>::iterator> > m_files;
+        std::map<int,bool> m_created;
+    };
+
+ private:
+    int partitionOf(const pss& table, const RowScanner& scanner);
+    void append(int partition, const std::string& line);
+    void flush(int partition);
+    void flushAll();
+
+ private:
+    static const size_t BUFFER_SIZE = 1 << 20;
+    static const size_t MAX_BUFFERED_SIZE = 64 << 20;
+
+ private:
+    const std::string m_output_dir;
+    const PartitionBy m_partition_by;
+    const int m_hash_column;
+    const int m_num_of_partitions;
+
+ private:
+    std::vector<Partition> m_partitions;
+    std::map<pss,int> m_table_partitions;
+    size_t m_buffered_size;
+
+ private:
+    std::vector<Writer*> m_writers;
+    std::vector<Poco::Thread*> m_threads;
+};
+
+#endif // #ifndef SHARDWRITER_H_202610191700
@@ -0,0 +1,515 @@
+#include "sqlwriter.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+namespace {
+
+unsigned long long readLittleEndian(const char* data, int size) {
+    unsigned long long n = 0;
+    for(int i = size - 1; i >= 0; --i) n = (n << 8) | static_cast<unsigned char>(data[i]);
+    return n;
+}
+
+unsigned long long readBigEndian(const char* data, int size) {
+    unsigned long long n = 0;
+    for(int i = 0; i < size; ++i) n = (n << 8) | static_cast<unsigned char>(data[i]);
+    return n;
+}
+
+long long signExtend(unsigned long long n, int size) {
+    if(size >= 8) return static_cast<long long>(n);
+    const unsigned long long sign = 1ULL << (8 * size - 1);
+    return static_cast<long long>((n ^ sign) - sign);
+}
+
+// Fractional seconds of TIMESTAMP2, DATETIME2 and TIME2 are stored in
+// (fsp + 1) / 2 bytes; the result is in microseconds.
+long long readMicroseconds(const char* data, unsigned int fsp) {
+    switch(fsp) {
+        case 1: case 2: return readBigEndian(data, 1) * 10000;
+        case 3: case 4: return readBigEndian(data, 2) * 100;
+        case 5: case 6: return readBigEndian(data, 3);
+        default: return 0;
+    }
+}
+
+string formatFraction(long long microseconds, unsigned int fsp) {
+    if(fsp == 0 || fsp > 6) return "";
+    char buf[8];
+    snprintf(buf, sizeof buf, "%06lld", microseconds);
+    return "." + string(buf, fsp);
+}
+
+string quoteString(const char* data, int size) {
+    string s("'");
+    for(int i = 0; i < size; ++i) {
+        switch(data[i]) {
+            case '\0': s += "\\0"; break;
+            case '\n': s += "\\n"; break;
+            case '\r': s += "\\r"; break;
+            case '\032': s += "\\Z"; break;
+            case '\\': s += "\\\\"; break;
+            case '\'': s += "\\'"; break;
+            case '"': s += "\\\""; break;
+            default: s += data[i]; break;
+        }
+    }
+    return s + '\'';
+}
+
+string hexString(const char* data, int size) {
+    if(size == 0) return "''";
+    static const char HEX[] = "0123456789ABCDEF";
+    string s("X'");
+    for(int i = 0; i < size; ++i) {
+        s += HEX[static_cast<unsigned char>(data[i]) >> 4];
+        s += HEX[static_cast<unsigned char>(data[i]) & 0xF];
+    }
+    return s + '\'';
+}
+
+// DECIMAL(precision, scale) is stored as groups of 9 digits in 4 bytes,
+// big-endian, with fewer bytes for the leftover digits; the sign bit is
+// flipped and negative values have all their bits inverted.
+bool formatDecimal(const char* data, int size, unsigned int meta, string& value) {
+    static const int DIG2BYTES[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    const int precision = meta >> 8;
+    const int scale = meta & 0xFF;
+    const int intg = precision - scale;
+    if(intg < 0) return false;
+    vector<char> bytes(data, data + size);
+    if(bytes.empty()) return false;
+    const bool negative = !(bytes[0] & 0x80);
+    bytes[0] ^= 0x80;
+    if(negative)
+        for(size_t i = 0; i < bytes.size(); ++i) bytes[i] = ~bytes[i];
+
+    int pos = 0;
+    char buf[16];
+    string integer;
+    for(int remaining = intg, leading = intg % 9; remaining > 0; leading = 0) {
+        const int digits = leading ? leading : 9;
+        const int byte_size = DIG2BYTES[digits];
+        if(pos + byte_size > size) return false;
+        snprintf(buf, sizeof buf, "%0*llu", digits, readBigEndian(&bytes[pos], byte_size));
+        integer += buf;
+        pos += byte_size;
+        remaining -= digits;
+    }
+    const size_t first_digit = integer.find_first_not_of('0');
+    integer = first_digit == string::npos ? "0" : integer.substr(first_digit);
+
+    string fraction;
+    for(int remaining = scale; remaining > 0;) {
+        const int digits = remaining >= 9 ? 9 : remaining;
+        const int byte_size = DIG2BYTES[digits];
+        if(pos + byte_size > size) return false;
+        snprintf(buf, sizeof buf, "%0*llu", digits, readBigEndian(&bytes[pos], byte_size));
+        fraction += buf;
+        pos += byte_size;
+        remaining -= digits;
+    }
+
+    value = (negative ? "-" : "") + integer + (fraction.empty() ? "" : "." + fraction);
+    return true;
+}
+
+}
+
+//******************************
+// SQL WRITER CLASS
+//******************************
+
+SQLWriter::SQLWriter(ostream& out, long long packet_size, const ColumnNames& column_names):
+    m_out(out), m_packet_size(packet_size), m_column_names(column_names), m_in_transaction(false), m_limit(false), m_num_of_rows(0)
+{
+}
+
+// DB.TABLE:COL,COL,... names the columns of DB.TABLE in table order.
+bool SQLWriter::ParseColumnNames(const string& text, ColumnNames& column_names) {
+    const string::size_type colon = text.find(':');
+    const string::size_type dot = text.find('.');
+    if(colon == string::npos || dot == string::npos || dot > colon) return false;
+
+    const pss table(text.substr(0, dot), text.substr(dot + 1, colon - dot - 1));
+    vector<string> names;
+    string::size_type begin = colon + 1;
+    for(;;) {
+        const string::size_type comma = text.find(',', begin);
+        names.push_back(text.substr(begin, comma == string::npos ? string::npos : comma - begin));
+        if(names.back().empty()) return false;
+        if(comma == string::npos) break;
+        begin = comma + 1;
+    }
+    if(table.first.empty() || table.second.empty()) return false;
+    column_names[table] = names;
+    return true;
+}
+
+bool SQLWriter::storeTableMap(const Event& event) {
+    Table& table = m_tables[event.getTableId()];
+    table.name = pss(event.getDBName(), event.getTableName());
+    table.quoted_name = QuoteIdentifier(table.name.first) + '.' + QuoteIdentifier(table.name.second);
+
+    const vector<string>* names = &event.getColumnNames();
+    if(names->empty()) {
+        ColumnNames::const_iterator it = m_column_names.find(table.name);
+        if(it != m_column_names.end()) names = &it->second;
+    }
+    if(!names->empty() && static_cast<int>(names->size()) != event.getNumOfColumns()) {
+        cerr << "--columns gives " << names->size() << " column names for " << table.name.first << '.' << table.name.second
+             << ", which has " << event.getNumOfColumns() << " columns" << endl;
+        return false;
+    }
+
+    table.has_column_names = !names->empty();
+    table.columns.resize(event.getNumOfColumns());
+    table.unsigned_columns.resize(event.getNumOfColumns());
+    for(int i = 0; i < event.getNumOfColumns(); ++i) {
+        table.columns[i] = table.has_column_names ? QuoteIdentifier((*names)[i]) : "";
+        table.unsigned_columns[i] = event.isUnsigned(i);
+    }
+    return true;
+}
+
+const SQLWriter::Table* SQLWriter::findTable(TableId table_id) const {
+    Tables::const_iterator it = m_tables.find(table_id);
+    return it == m_tables.end() ? NULL : &it->second;
+}
+
+// Statements that name columns cannot be written for a table whose column
+// names are unknown.
+const SQLWriter::Table* SQLWriter::findTable(TableId table_id, const char* statement, bool needs_column_names) const {
+    const Table* table = findTable(table_id);
+    if(!table) {
+        cerr << "cannot write " << statement << ": no TABLE_MAP_EVENT for table id " << table_id << endl;
+        return NULL;
+    }
+    if(needs_column_names && !table->has_column_names) {
+        cerr << "cannot write " << statement << " on " << table->name.first << '.' << table->name.second
+             << ": its column names are not in the binlog (binlog_row_metadata=FULL);"
+             << " give them with --columns=" << table->name.first << '.' << table->name.second << ":COL,COL,..." << endl;
+        return NULL;
+    }
+    return table;
+}
+
+bool SQLWriter::render(const RowScanner& scanner, SQLRow& row) const {
+    const Table* table = findTable(scanner.getTableId());
+    const int num_of_columns = scanner.getNumOfColumns();
+    row.values.assign(num_of_columns, string());
+    row.used.assign(num_of_columns, 0);
+    row.has_null = false;
+    for(int i = 0; i < num_of_columns; ++i) {
+        if(!scanner.isUsed(i)) continue;
+        row.used[i] = 1;
+        if(scanner.isNull(i)) {
+            row.values[i] = "NULL";
+            row.has_null = true;
+            continue;
+        }
+        const bool is_unsigned = table && i < static_cast<int>(table->unsigned_columns.size()) && table->unsigned_columns[i];
+        if(!RenderValue(scanner.getColumnType(i), scanner.getMetadata(i), is_unsigned,
+                        scanner.getColumnData(i), scanner.getColumnSize(i), row.values[i])) {
+            cerr << "cannot write column type " << scanner.getColumnType(i) << " as SQL" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SQLWriter::begin() {
+    flush();
+    m_out << "BEGIN;" << '\n';
+    m_in_transaction = true;
+}
+
+void SQLWriter::commit() {
+    flush();
+    m_out << "COMMIT;" << '\n';
+    m_in_transaction = false;
+}
+
+// Ends a transaction that cannot be written whole, so that a replay is not
+// left with part of it applied, or open; rows not yet written are dropped.
+void SQLWriter::rollback() {
+    m_prefix.clear();
+    m_statement.clear();
+    m_num_of_rows = 0;
+    if(!m_in_transaction) return;
+    m_out << "ROLLBACK;" << '\n';
+    m_in_transaction = false;
+}
+
+bool SQLWriter::insert(TableId table_id, const SQLRow& row) {
+    // without column names only a full row image can be inserted, positionally
+    bool complete = true;
+    for(size_t i = 0; i < row.used.size(); ++i) complete = complete && row.used[i];
+    const Table* table = findTable(table_id, "INSERT", !complete);
+    if(!table) return false;
+    const string columns = table->has_column_names ? ' ' + ColumnList(*table, row) : "";
+    append("INSERT INTO " + table->quoted_name + columns + " VALUES ", Tuple(row), false);
+    return true;
+}
+
+bool SQLWriter::remove(TableId table_id, const SQLRow& row) {
+    const Table* table = findTable(table_id, "DELETE", true);
+    if(!table) return false;
+    if(row.has_null) {
+        // NULL never matches IN (...)
+        flush();
+        m_out << "DELETE FROM " << table->quoted_name << " WHERE " << Condition(*table, row) << " LIMIT 1;" << '\n';
+        return true;
+    }
+    append("DELETE FROM " + table->quoted_name + " WHERE " + ColumnList(*table, row) + " IN (", Tuple(row), true);
+    return true;
+}
+
+bool SQLWriter::update(TableId table_id, const SQLRow& before, const SQLRow& after) {
+    const Table* table = findTable(table_id, "UPDATE", true);
+    if(!table) return false;
+    flush();
+    m_out << "UPDATE " << table->quoted_name << " SET ";
+    bool first = true;
+    for(size_t i = 0; i < after.used.size(); ++i) {
+        if(!after.used[i]) continue;
+        if(!first) m_out << ", ";
+        m_out << table->columns[i] << '=' << after.values[i];
+        first = false;
+    }
+    m_out << " WHERE " << Condition(*table, before) << " LIMIT 1;" << '\n';
+    return true;
+}
+
+// Statements such as DDL run in the default database they were logged with.
+// The mysql client splits its input at the delimiter, so a statement with
+// semicolons of its own, such as CREATE PROCEDURE, is ended by another one.
+// A statement logged with LOG_EVENT_SUPPRESS_USE_F, such as CREATE
+// DATABASE, runs without its database, which need not exist yet.
+void SQLWriter::statement(const string& database, const string& sql_statement, bool suppress_use) {
+    flush();
+    if(!suppress_use && !database.empty() && database != m_database) {
+        m_out << "USE " << QuoteIdentifier(database) << ';' << '\n';
+        m_database = database;
+    }
+    if(sql_statement.find(';') == string::npos) {
+        m_out << sql_statement << ';' << '\n';
+        return;
+    }
+    string delimiter("$$");
+    while(sql_statement.find(delimiter) != string::npos) delimiter += '$';
+    m_out << "DELIMITER " << delimiter << '\n'
+          << sql_statement << '\n' << delimiter << '\n'
+          << "DELIMITER ;" << '\n';
+}
+
+void SQLWriter::flush() {
+    if(m_num_of_rows == 0) return;
+    m_out << m_prefix << m_statement;
+    if(m_limit) m_out << ") LIMIT " << m_num_of_rows;
+    m_out << ';' << '\n';
+    m_prefix.clear();
+    m_statement.clear();
+    m_num_of_rows = 0;
+}
+
+// Rows are merged while the statement has the same prefix, i.e. the same
+// kind, table and columns, and stays below the packet size.
+void SQLWriter::append(const string& prefix, const string& tuple, bool limit) {
+    const long long LIMIT_CLAUSE_BYTE_SIZE = 32;
+    if(m_num_of_rows > 0 &&
+       (prefix != m_prefix ||
+        static_cast<long long>(m_prefix.size() + m_statement.size() + 1 + tuple.size()) + LIMIT_CLAUSE_BYTE_SIZE > m_packet_size)) {
+        flush();
+    }
+    if(m_num_of_rows == 0) {
+        m_prefix = prefix;
+        m_statement = tuple;
+        m_limit = limit;
+    }
+    else {
+        m_statement += ',';
+        m_statement += tuple;
+    }
+    ++m_num_of_rows;
+}
+
+string SQLWriter::ColumnList(const Table& table, const SQLRow& row) {
+    string s("(");
+    for(size_t i = 0; i < row.used.size() && i < table.columns.size(); ++i) {
+        if(!row.used[i]) continue;
+        if(s.size() > 1) s += ',';
+        s += table.columns[i];
+    }
+    return s + ')';
+}
+
+string SQLWriter::Tuple(const SQLRow& row) {
+    string s("(");
+    for(size_t i = 0; i < row.used.size(); ++i) {
+        if(!row.used[i]) continue;
+        if(s.size() > 1) s += ',';
+        s += row.values[i];
+    }
+    return s + ')';
+}
+
+string SQLWriter::Condition(const Table& table, const SQLRow& row) {
+    string s;
+    for(size_t i = 0; i < row.used.size() && i < table.columns.size(); ++i) {
+        if(!row.used[i]) continue;
+        if(!s.empty()) s += " AND ";
+        s += table.columns[i] + "<=>" + row.values[i];
+    }
+    return s;
+}
+
+string SQLWriter::QuoteIdentifier(const string& name) {
+    string s("`");
+    for(size_t i = 0; i < name.size(); ++i) {
+        if(name[i] == '`') s += '`';
+        s += name[i];
+    }
+    return s + '`';
+}
+
+// Values are decoded the way the server stores them in row images; see
+// Event::GetColumnImageSize for their sizes.
+bool SQLWriter::RenderValue(ColumnType ctype, unsigned int meta, bool is_unsigned,
+                            const char* data, int size, string& value) {
+    char buf[64];
+    switch(ctype) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG: {
+            const unsigned long long n = readLittleEndian(data, size);
+            value = is_unsigned ? to_string(n) : to_string(signExtend(n, size));
+            return true;
+        }
+        case MYSQL_TYPE_FLOAT: {
+            float f;
+            if(size != sizeof f) return false;
+            memcpy(&f, data, sizeof f);
+            snprintf(buf, sizeof buf, "%.9g", f);
+            value = buf;
+            return true;
+        }
+        case MYSQL_TYPE_DOUBLE: {
+            double d;
+            if(size != sizeof d) return false;
+            memcpy(&d, data, sizeof d);
+            snprintf(buf, sizeof buf, "%.17g", d);
+            value = buf;
+            return true;
+        }
+        case MYSQL_TYPE_NEWDECIMAL:
+            return formatDecimal(data, size, meta, value);
+        case MYSQL_TYPE_YEAR: {
+            const unsigned long long n = readLittleEndian(data, size);
+            value = to_string(n == 0 ? 0 : 1900 + n);
+            return true;
+        }
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_NEWDATE: {
+            const unsigned long long n = readLittleEndian(data, size);
+            snprintf(buf, sizeof buf, "'%04llu-%02llu-%02llu'", n >> 9, (n >> 5) & 15, n & 31);
+            value = buf;
+            return true;
+        }
+        case MYSQL_TYPE_TIME: {
+            const long long n = signExtend(readLittleEndian(data, size), size);
+            const long long a = n < 0 ? -n : n;
+            snprintf(buf, sizeof buf, "'%s%02lld:%02lld:%02lld'", n < 0 ? "-" : "", a / 10000, a / 100 % 100, a % 100);
+            value = buf;
+            return true;
+        }
+        case MYSQL_TYPE_DATETIME: {
+            const unsigned long long n = readLittleEndian(data, size);
+            const unsigned long long d = n / 1000000;
+            const unsigned long long t = n % 1000000;
+            snprintf(buf, sizeof buf, "'%04llu-%02llu-%02llu %02llu:%02llu:%02llu'",
+                     d / 10000, d / 100 % 100, d % 100, t / 10000, t / 100 % 100, t % 100);
+            value = buf;
+            return true;
+        }
+        case MYSQL_TYPE_TIMESTAMP:
+        case MYSQL_TYPE_TIMESTAMP2: {
+            // FROM_UNIXTIME keeps the instant whatever the session time zone
+            const bool v2 = MYSQL_TYPE_TIMESTAMP2 == ctype;
+            const unsigned long long seconds = v2 ? readBigEndian(data, 4) : readLittleEndian(data, 4);
+            const long long microseconds = v2 ? readMicroseconds(data + 4, meta) : 0;
+            if(seconds == 0 && microseconds == 0) value = "'0000-00-00 00:00:00'";
+            else value = "FROM_UNIXTIME(" + to_string(seconds) + formatFraction(microseconds, v2 ? meta : 0) + ')';
+            return true;
+        }
+        case MYSQL_TYPE_DATETIME2: {
+            const long long n = readBigEndian(data, 5) - 0x8000000000LL;
+            const long long ymd = n >> 17;
+            const long long ym = ymd >> 5;
+            const long long hms = n & 0x1FFFF;
+            snprintf(buf, sizeof buf, "%04lld-%02lld-%02lld %02lld:%02lld:%02lld",
+                     ym / 13, ym % 13, ymd & 31, hms >> 12, (hms >> 6) & 63, hms & 63);
+            value = '\'' + string(buf) + formatFraction(readMicroseconds(data + 5, meta), meta) + '\'';
+            return true;
+        }
+        case MYSQL_TYPE_TIME2: {
+            // packed as (hours << 12 | minutes << 6 | seconds) << 24 plus
+            // microseconds, offset to be unsigned; with a short fraction a
+            // negative time borrows one second from the integer part
+            long long packed = readBigEndian(data, 3) - 0x800000LL;
+            if(meta == 1 || meta == 2 || meta == 3 || meta == 4) {
+                const bool short_fraction = meta <= 2;
+                long long frac = short_fraction ? static_cast<signed char>(data[3])
+                                                : static_cast<short>(readBigEndian(data + 3, 2));
+                if(packed < 0 && frac) {
+                    ++packed;
+                    frac -= short_fraction ? 0x100 : 0x10000;
+                }
+                packed = packed * (1LL << 24) + frac * (short_fraction ? 10000 : 100);
+            }
+            else if(meta == 5 || meta == 6) {
+                packed = readBigEndian(data, 6) - 0x800000000000LL;
+            }
+            else {
+                packed *= 1LL << 24;
+            }
+            const bool negative = packed < 0;
+            const long long a = negative ? -packed : packed;
+            const long long hms = a >> 24;
+            snprintf(buf, sizeof buf, "%s%02lld:%02lld:%02lld", negative ? "-" : "",
+                     (hms >> 12) % 1024, (hms >> 6) % 64, hms % 64);
+            value = '\'' + string(buf) + formatFraction(a % (1LL << 24), meta) + '\'';
+            return true;
+        }
+        case MYSQL_TYPE_BIT:
+            value = to_string(readBigEndian(data, size));
+            return true;
+        case MYSQL_TYPE_ENUM:
+        case MYSQL_TYPE_SET:
+            value = to_string(readLittleEndian(data, size));
+            return true;
+        case MYSQL_TYPE_VARCHAR:
+        case MYSQL_TYPE_VAR_STRING:
+        case MYSQL_TYPE_STRING: {
+            if(MYSQL_TYPE_STRING == ctype && ((meta >> 8) == MYSQL_TYPE_ENUM || (meta >> 8) == MYSQL_TYPE_SET)) {
+                value = to_string(readLittleEndian(data, size));
+                return true;
+            }
+            const int prefix = Event::GetLengthPrefixSize(ctype, meta);
+            if(size < prefix) return false;
+            value = quoteString(data + prefix, size - prefix);
+            return true;
+        }
+        case MYSQL_TYPE_BLOB:
+        case MYSQL_TYPE_GEOMETRY:
+            if(size < static_cast<int>(meta)) return false;
+            value = hexString(data + meta, size - meta);
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef SQLWRITER_H_202610200100
+#define SQLWRITER_H_202610200100
+
+#include "mysqlbinlog.h"
+#include <ostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// A row image rendered as SQL literals. Columns left out of the image, as
+// binlog_row_image=MINIMAL does, are not used.
+struct SQLRow {
+    std::vector<std::string> values;
+    std::vector<char> used;
+    bool has_null;
+};
+
+// Column names by table, for binlogs that do not carry them.
+typedef std::map<pss,std::vector<std::string> > ColumnNames;
+
+// Writes row changes, and statements logged as such, as executable SQL.
+// Consecutive rows inserted into, or deleted from, the same table are
+// merged into one multi-row statement for as long as it stays below the
+// packet size; updates are written one row per statement. Rows are matched
+// on every column of their image.
+//
+// Column names and signedness come from TABLE_MAP_EVENT, which has them
+// only on MySQL 8.0 with binlog_row_metadata=FULL. Other tables need their
+// names given in column_names to be updated or deleted from, and to have
+// rows of a partial image inserted; their integers are taken as signed.
+class SQLWriter {
+ public:
+    SQLWriter(std::ostream& out, long long packet_size, const ColumnNames& column_names);
+
+ public:
+    bool storeTableMap(const Event& event);
+    bool render(const RowScanner& scanner, SQLRow& row) const;
+
+ public:
+    void begin();
+    void commit();
+    void rollback();
+    bool insert(TableId table_id, const SQLRow& row);
+    bool remove(TableId table_id, const SQLRow& row);
+    bool update(TableId table_id, const SQLRow& before, const SQLRow& after);
+    void statement(const std::string& database, const std::string& sql_statement, bool suppress_use);
+    void flush();
+
+ public:
+    static bool ParseColumnNames(const std::string& text, ColumnNames& column_names);
+
+ public:
+    static const long long DEFAULT_PACKET_SIZE = 1024 * 1024;
+
+ private:
+    struct Table {
+        pss name;
+        std::string quoted_name;
+        std::vector<std::string> columns;
+        std::vector<char> unsigned_columns;
+        bool has_column_names;
+    };
+    typedef std::map<TableId, Table> Tables;
+
+ private:
+    const Table* findTable(TableId table_id) const;
+    const Table* findTable(TableId table_id, const char* statement, bool needs_column_names) const;
+    void append(const std::string& prefix, const std::string& tuple, bool limit);
+
+ private:
+    static std::string ColumnList(const Table& table, const SQLRow& row);
+    static std::string Tuple(const SQLRow& row);
+    static std::string Condition(const Table& table, const SQLRow& row);
+
+ private:
+    static bool RenderValue(ColumnType ctype, unsigned int meta, bool is_unsigned,
+                            const char* data, int size, std::string& value);
+    static std::string QuoteIdentifier(const std::string& name);
+
+ private:
+    std::ostream& m_out;
+    const long long m_packet_size;
+    const ColumnNames m_column_names;
+    Tables m_tables;
+    std::string m_database;
+    bool m_in_transaction;
+
+ private:
+    // the statement rows are being merged into; DELETE ... IN (...) ends
+    // with a LIMIT of its number of rows, so duplicates are not all removed
+    std::string m_prefix;
+    std::string m_statement;
+    bool m_limit;
+    int m_num_of_rows;
+};
+
+#endif // #ifndef SQLWRITER_H_202610200100
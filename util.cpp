@@ -0,0 +1,52 @@
+#include "util.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+using namespace std;
+
+string formatTimestamp(long long epoch) {
+    const time_t t = static_cast<time_t>(epoch);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[32];
+    snprintf(buf, sizeof buf, "%d/%02d/%02d %02d:%02d:%02d",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    return buf;
+}
+
+string escapeJSON(const string& s) {
+    string escaped;
+    for(string::const_iterator it = s.begin(); it != s.end(); ++it) {
+        const unsigned char c = static_cast<unsigned char>(*it);
+        if(c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += *it;
+        }
+        else if(c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            escaped += buf;
+        }
+        else {
+            escaped += *it;
+        }
+    }
+    return escaped;
+}
+
+void printRowImg(ostream& out, const vector<string>& row) {
+    for(vector<string>::const_iterator it = row.begin(); it != row.end(); ++it) {
+        if(it != row.begin()) out << ',';
+        out << *it;
+    }
+}
+
+bool parseByteSize(const string& text, long long& byte_size) {
+    char* endp = NULL;
+    byte_size = strtoll(text.c_str(), &endp, 10);
+    if(endp == text.c_str() || byte_size < 0) return false;
+    if(*endp == 'K' || *endp == 'k') byte_size <<= 10, ++endp;
+    else if(*endp == 'M' || *endp == 'm') byte_size <<= 20, ++endp;
+    else if(*endp == 'G' || *endp == 'g') byte_size <<= 30, ++endp;
+    return *endp == '\0';
+}
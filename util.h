@@ -0,0 +1,19 @@
+#ifndef UTIL_H_202610191530
+#define UTIL_H_202610191530
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// "2015/06/14 07:19:09", the format printTimestamp uses, without the zone.
+std::string formatTimestamp(long long epoch);
+
+std::string escapeJSON(const std::string& s);
+
+// Comma separated column values, as the row printers write them.
+void printRowImg(std::ostream& out, const std::vector<std::string>& row);
+
+// Parses "1048576", "512K", "256M" or "4G".
+bool parseByteSize(const std::string& text, long long& byte_size);
+
+#endif // #ifndef UTIL_H_202610191530